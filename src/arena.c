@@ -0,0 +1,187 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "arena.h"
+
+/* fprintf(3) */
+#include <stdio.h>
+
+/* malloc(3) */
+#include <stdlib.h>
+
+/* strlen(3), memcpy(3) */
+#include <string.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/*******************************
+ Memory arena handling functions
+ *******************************/
+
+/* Return the approximate amount of memory malloc(3) uses to hold an object
+   of a given size (header and alignment included). This is only used to
+   report memory savings */
+static size_t
+malloc_footprint(size_t size)
+{
+    return (max(4 * sizeof(size_t),
+        round_num(size + sizeof(size_t), 2 * sizeof(size_t))));
+}
+
+/* Allocate a new chunk able to hold at least size bytes and make it
+   the current one
+   - returns 0 (success) or 1 (failure) */
+static int
+arena_grow(struct arena *arena, size_t size)
+{
+    assert(arena != NULL);
+
+    struct arena_chunk *chunk = NULL;
+
+    /* start with small chunks and double their size up to arena->chunk_size
+       to avoid wasting memory when only a few objects are allocated */
+    size_t chunk_size = min(arena->chunk_size, ARENA_FIRST_CHUNK_SIZE);
+    if(arena->head != NULL)
+        chunk_size = min(arena->chunk_size, arena->head->size * 2);
+    chunk_size = max(chunk_size, size);
+
+    /* chunk header and data are allocated at once */
+    if_not_malloc(chunk, sizeof(struct arena_chunk) + chunk_size,
+        return (1);
+    )
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->data = (char *)chunk + sizeof(struct arena_chunk);
+    chunk->prevp = arena->head;
+    arena->head = chunk;
+
+    arena->num_chunks++;
+    arena->chunk_bytes += sizeof(struct arena_chunk) + chunk_size;
+    return (0);
+}
+
+/* Initialize an empty arena
+   - chunk_size is the default size of chunks (0 means ARENA_CHUNK_SIZE) */
+void
+init_arena(struct arena *arena, size_t chunk_size)
+{
+    assert(arena != NULL);
+
+    arena->head = NULL;
+    arena->chunk_size = (chunk_size > 0) ? chunk_size : ARENA_CHUNK_SIZE;
+    arena->num_objects = 0;
+    arena->num_chunks = 0;
+    arena->chunk_bytes = 0;
+    arena->malloc_bytes = 0;
+    return;
+}
+
+/* Release every chunk (and object) of an arena
+   - arena is left initialized and empty, ready to be used again */
+void
+uninit_arena(struct arena *arena)
+{
+    assert(arena != NULL);
+
+    struct arena_chunk *current = arena->head;
+    struct arena_chunk *prev = NULL;
+
+    while(current != NULL) {
+        prev = current->prevp;
+        free(current);
+        current = prev;
+    }
+    init_arena(arena, arena->chunk_size);
+    return;
+}
+
+/* Allocate size bytes (aligned on ARENA_ALIGN) from an arena
+   - returns NULL if memory cannot be allocated */
+void *
+arena_alloc(struct arena *arena, size_t size)
+{
+    assert(arena != NULL);
+
+    /* align current chunk's free space */
+    size_t offset = 0;
+    if(arena->head != NULL)
+        offset = round_num(arena->head->used, ARENA_ALIGN);
+
+    if((arena->head == NULL) || ((offset + size) > arena->head->size)) {
+        /* chunk data is aligned as it follows the chunk header */
+        if(arena_grow(arena, size) != 0)
+            return (NULL);
+        offset = 0;
+    }
+
+    void *ptr = arena->head->data + offset;
+    arena->head->used = offset + size;
+
+    arena->num_objects++;
+    arena->malloc_bytes += malloc_footprint(size);
+    return (ptr);
+}
+
+/* Copy len bytes of a string into an arena and terminate it with '\0'
+   (string data is packed, not aligned)
+   - returns NULL if memory cannot be allocated */
+char *
+arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+    assert(arena != NULL);
+    assert(str != NULL);
+
+    size_t size = len + 1;
+
+    if((arena->head == NULL) || ((arena->head->used + size) > arena->head->size)) {
+        if(arena_grow(arena, size) != 0)
+            return (NULL);
+    }
+
+    char *ptr = arena->head->data + arena->head->used;
+    memcpy(ptr, str, len);
+    ptr[len] = '\0';
+    arena->head->used += size;
+
+    arena->num_objects++;
+    arena->malloc_bytes += malloc_footprint(size);
+    return (ptr);
+}
+
+/* Copy a string into an arena (string data is packed, not aligned)
+   - returns NULL if memory cannot be allocated */
+char *
+arena_strdup(struct arena *arena, const char *str)
+{
+    assert(arena != NULL);
+    assert(str != NULL);
+
+    return (arena_strndup(arena, str, strlen(str)));
+}
@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include "types.h"
+
+/* size_t */
+#include <stddef.h>
+
+#if !defined(ARENA_CHUNK_SIZE)
+#define ARENA_CHUNK_SIZE (1024 * 1024)  /* default chunk size, in bytes */
+#endif
+
+#if !defined(ARENA_FIRST_CHUNK_SIZE)
+#define ARENA_FIRST_CHUNK_SIZE 4096     /* size of the first chunk, in bytes */
+#endif
+
+/* Alignment of objects returned by arena_alloc() */
+#define ARENA_ALIGN \
+    ((sizeof(long long) > sizeof(void *)) ? sizeof(long long) : sizeof(void *))
+
+/* A chunk of memory, objects are carved out of it */
+struct arena_chunk;
+struct arena_chunk {
+    size_t size;                    /* usable size, in bytes */
+    size_t used;                    /* used bytes */
+    char *data;                     /* usable memory */
+
+    struct arena_chunk* prevp;      /* previous chunk */
+};
+
+/* A memory arena (bump allocator) ; objects cannot be freed one by one,
+   they are all released at once when the arena is un-initialized */
+struct arena {
+    struct arena_chunk *head;       /* current chunk */
+    size_t chunk_size;              /* default chunk size */
+
+    /* statistics */
+    fnum_t num_objects;             /* number of objects allocated */
+    fnum_t num_chunks;              /* number of chunks allocated */
+    size_t chunk_bytes;             /* bytes allocated through malloc(3) */
+    size_t malloc_bytes;            /* estimated bytes malloc(3) would have
+                                       needed for the same objects */
+};
+
+void init_arena(struct arena *arena, size_t chunk_size);
+void uninit_arena(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_strndup(struct arena *arena, const char *str, size_t len);
+char *arena_strdup(struct arena *arena, const char *str);
+
+#endif /* _ARENA_H */
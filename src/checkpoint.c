@@ -0,0 +1,242 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "options.h"
+#include "partition.h"
+#include "file_entry.h"
+#include "dispatch.h"
+#include "output.h"
+#include "checkpoint.h"
+
+/* fprintf(3) */
+#include <stdio.h>
+
+/* malloc(3), qsort(3) */
+#include <stdlib.h>
+
+/* strlen(3) */
+#include <string.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/*****************************************
+ Checkpoint functions (option -K)
+ *****************************************/
+
+/* Every options->checkpoint_entries file entries, in-memory entries are
+   sorted and dispatched to partitions, appended to partition files and
+   released. Partitions are kept from one checkpoint to another, so each
+   batch is dispatched (largest files first) on top of previous ones, which
+   keeps partitions balanced while bounding memory usage. Partition files
+   are flushed at each checkpoint : if fpart gets interrupted, they contain
+   every file entry handled up to the last checkpoint */
+
+/* Status */
+static struct {
+    unsigned char initialized;
+    struct partition_table partitions;  /* partitions, loaded by every
+                                           checkpoint */
+    struct out_files files;             /* partition files */
+    fnum_t num_entries;                 /* in-memory entries */
+    fnum_t total_entries;               /* entries dispatched so far */
+    unsigned int num_checkpoints;
+} checkpoint = {
+    0,
+    { NULL, 0, 0 },
+    { NULL, 0, NULL, 0, 0, NULL, NULL },
+    0,
+    0,
+    0
+};
+
+/* Initialize partitions and partition files
+   - returns 0 (success) or 1 (failure) */
+static int
+init_checkpoint(struct program_options *options)
+{
+    assert(options != NULL);
+    assert(options->num_parts > 0);
+    assert(options->out_filename != NULL);
+
+    if(checkpoint.initialized)
+        return (0);
+
+    init_partitions(&checkpoint.partitions);
+    if(add_partitions(&checkpoint.partitions, options->num_parts,
+        options) != 0) {
+        fprintf(stderr, "%s(): cannot init table of partitions\n",
+            __func__);
+        uninit_partitions(&checkpoint.partitions);
+        return (1);
+    }
+    if(init_out_files(&checkpoint.files, options->out_filename,
+        options->num_parts, OUTPUT_MAX_BUFFER_SIZE) != 0) {
+        uninit_partitions(&checkpoint.partitions);
+        return (1);
+    }
+    checkpoint.initialized = 1;
+    return (0);
+}
+
+/* Sort and dispatch in-memory file entries, write them to partition files
+   and release them
+   - returns 0 (success) or 1 (failure) */
+static int
+checkpoint_flush(struct file_entry **head, struct program_options *options)
+{
+    assert(head != NULL);
+    assert(options != NULL);
+
+    struct file_entry *start = *head;
+    struct file_entry **file_entry_p = NULL;
+    char *ln_term = (options->out_zero == OPT_OUT0) ? "\0" : "\n";
+    fnum_t num_entries = checkpoint.num_entries;
+    fnum_t i;
+
+    if(init_checkpoint(options) != 0)
+        return (1);
+
+    if((start != NULL) && (num_entries > 0)) {
+        rewind_list(start);
+
+        /* sort entries */
+        if_not_malloc(file_entry_p,
+            sizeof(struct file_entry *) * num_entries,
+            return (1);
+        )
+        init_file_entry_p(file_entry_p, num_entries, start);
+        if(radix_sort_file_entry_p(file_entry_p, num_entries) != 0)
+            qsort(&file_entry_p[0], num_entries, sizeof(struct file_entry *),
+                &sort_file_entry_p);
+
+        /* dispatch them on top of previous checkpoints, then spread empty
+           files given the total number of files seen so far (unless files
+           have a cost, empty ones are then already spread) */
+        checkpoint.total_entries += num_entries;
+        if((dispatch_file_entry_p_by_size(file_entry_p, num_entries,
+            &checkpoint.partitions, options->file_cost) != 0) ||
+            ((options->file_cost == 0) &&
+            (dispatch_empty_file_entries(start, checkpoint.total_entries,
+            &checkpoint.partitions) != 0))) {
+            fprintf(stderr, "%s(): unable to dispatch file entries\n",
+                __func__);
+            free(file_entry_p);
+            return (1);
+        }
+        free(file_entry_p);
+
+        /* append them to partition files */
+        for(i = 0 ; start != NULL ; i++) {
+            const char *path = file_entry_path(start);
+            if((path == NULL) ||
+                (out_files_write(&checkpoint.files, start->partition_index,
+                path, strlen(path)) != 0) ||
+                (out_files_write(&checkpoint.files, start->partition_index,
+                ln_term, 1) != 0))
+                return (1);
+            start = start->nextp;
+        }
+        assert(i == num_entries);
+    }
+
+    /* make progress persistent */
+    if(out_files_flush(&checkpoint.files) != 0)
+        return (1);
+
+    checkpoint.num_checkpoints++;
+    if(options->verbose >= OPT_VERBOSE)
+        fprintf(stderr, "Checkpoint #%u: %lld file(s) written "
+            "(%lld total)\n", checkpoint.num_checkpoints, num_entries,
+            checkpoint.total_entries);
+
+    /* release entries */
+    uninit_file_entries(options);
+    *head = NULL;
+    checkpoint.num_entries = 0;
+    return (0);
+}
+
+/* Account for a file entry just added and flush in-memory entries to
+   partitions if checkpoint is reached (option -K)
+   - returns 0 (success) or 1 (failure) */
+int
+checkpoint_add(struct file_entry **head, struct program_options *options)
+{
+    assert(head != NULL);
+    assert(options != NULL);
+    assert(options->checkpoint_entries > 0);
+
+    checkpoint.num_entries++;
+
+    if(checkpoint.num_entries >= options->checkpoint_entries)
+        return (checkpoint_flush(head, options));
+    return (0);
+}
+
+/* Flush remaining file entries, close partition files and hand resulting
+   partitions over to caller (it must un-initialize them)
+   - returns 0 (success) or 1 (failure) */
+int
+checkpoint_finish(struct file_entry **head,
+    struct partition_table *partitions, struct program_options *options)
+{
+    assert(head != NULL);
+    assert(partitions != NULL);
+    assert(options != NULL);
+
+    int error = 0;
+
+    if(checkpoint_flush(head, options) != 0)
+        error = 1;
+    if(!checkpoint.initialized)
+        return (1);
+
+    if(uninit_out_files(&checkpoint.files) != 0)
+        error = 1;
+    *partitions = checkpoint.partitions;
+    init_partitions(&checkpoint.partitions);
+    checkpoint.initialized = 0;
+    return (error);
+}
+
+/* Release checkpoint status (on error) */
+void
+uninit_checkpoint(void)
+{
+    if(checkpoint.initialized) {
+        uninit_out_files(&checkpoint.files);
+        uninit_partitions(&checkpoint.partitions);
+        checkpoint.initialized = 0;
+    }
+    checkpoint.num_entries = 0;
+    checkpoint.total_entries = 0;
+    checkpoint.num_checkpoints = 0;
+    return;
+}
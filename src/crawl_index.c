@@ -0,0 +1,576 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "arena.h"
+#include "output.h"
+#include "crawl_index.h"
+
+/* fprintf(3), snprintf(3), rename(2) */
+#include <stdio.h>
+
+/* malloc(3), qsort(3), mkstemp(3) */
+#include <stdlib.h>
+
+/* strerror(3), strlen(3), memcmp(3), memset(3) */
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* open(2) */
+#include <fcntl.h>
+
+/* close(2), fstat(2), unlink(2) */
+#include <unistd.h>
+
+/* mmap(2), munmap(2) */
+#include <sys/mman.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/*********************************
+ Crawl index functions (option -I)
+ *********************************/
+
+/* Sub-second part of modification time, if available */
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+#define st_mtime_nsec(st)   ((st)->st_mtim.tv_nsec)
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+#define st_mtime_nsec(st)   ((st)->st_mtimespec.tv_nsec)
+#endif
+
+/* Status */
+static struct {
+    /* hash of crawling options, see crawl_index_options() */
+    uint64_t options;
+
+    /* previous index, memory-mapped */
+    void *map;
+    size_t map_size;
+    const struct crawl_index_record *records;
+    uint64_t num_records;
+    uint64_t num_roots;
+    const char *names;
+    uint64_t names_size;
+
+    /* index being built */
+    unsigned char initialized;
+    struct arena nodes;             /* nodes and their names */
+    struct crawl_index_node *roots;
+    uint64_t num_nodes;
+} crawl_index = {
+    0,
+    NULL,
+    0,
+    NULL,
+    0,
+    0,
+    NULL,
+    0,
+    0,
+    { NULL, 0, 0, 0, 0, 0 },
+    NULL,
+    0
+};
+
+/* Compare two names, as they are sorted within an index */
+static int
+crawl_index_cmp(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    assert(a != NULL);
+    assert(b != NULL);
+
+    int res = memcmp(a, b, min(a_len, b_len));
+
+    if(res != 0)
+        return (res);
+    return ((a_len > b_len) - (a_len < b_len));
+}
+
+/* Add len bytes of data to an FNV-1a hash */
+static uint64_t
+crawl_index_hash(uint64_t hash, const void *data, size_t len)
+{
+    assert((data != NULL) || (len == 0));
+
+    const unsigned char *bytes = data;
+    size_t i;
+
+    for(i = 0 ; i < len ; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return (hash);
+}
+
+/* Hash crawling options that shape the index: include/exclude options
+   (-y, -Y, -x and -X), as entries they reject are neither added nor
+   recorded, and options changing which entries are found or how they are
+   examined (-l, -b, -z, -d, -D and -E). An index can only be reused with
+   the same options (else, a directory left unchanged would be read from an
+   index recorded differently) */
+static uint64_t
+crawl_index_options(const struct program_options *options)
+{
+    assert(options != NULL);
+
+    char **lists[] = { options->include_files, options->include_files_ci,
+        options->exclude_files, options->exclude_files_ci };
+    unsigned int nlists[] = { options->ninclude_files,
+        options->ninclude_files_ci, options->nexclude_files,
+        options->nexclude_files_ci };
+    int64_t values[] = { options->follow_symbolic_links,
+        options->cross_fs_boundaries, options->dirs_include,
+        options->dir_depth, options->leaf_dirs, options->dirs_only };
+    uint64_t hash = 14695981039346656037ULL;
+    unsigned int l, i;
+
+    for(l = 0 ; l < sizeof(lists) / sizeof(lists[0]) ; l++) {
+        /* patterns end with '\0', list ends with an extra '\0' */
+        for(i = 0 ; i < nlists[l] ; i++)
+            hash = crawl_index_hash(hash, lists[l][i],
+                strlen(lists[l][i]) + 1);
+        hash = crawl_index_hash(hash, "", 1);
+    }
+    return (crawl_index_hash(hash, values, sizeof(values)));
+}
+
+/* Check a memory-mapped index
+   - returns 0 if index is valid, else 1 */
+static int
+crawl_index_check(const void *map, size_t map_size)
+{
+    assert(map != NULL);
+
+    const struct crawl_index_header *header = map;
+    const struct crawl_index_record *records = NULL;
+    const char *names = NULL;
+    uint64_t i;
+
+    if((map_size < sizeof(struct crawl_index_header)) ||
+        (memcmp(header->magic, CRAWL_INDEX_MAGIC, sizeof(header->magic)) !=
+        0) ||
+        (header->version != CRAWL_INDEX_VERSION) ||
+        (header->record_size != sizeof(struct crawl_index_record)) ||
+        (header->byte_order != CRAWL_INDEX_BYTE_ORDER) ||
+        (header->num_roots > header->num_records) ||
+        (header->num_records > (map_size - sizeof(struct crawl_index_header)) /
+        sizeof(struct crawl_index_record)) ||
+        (header->names_size != map_size - sizeof(struct crawl_index_header) -
+        (header->num_records * sizeof(struct crawl_index_record))))
+        return (1);
+
+    records = (const struct crawl_index_record *)&header[1];
+    names = (const char *)&records[header->num_records];
+    for(i = 0 ; i < header->num_records ; i++) {
+        if((records[i].name_offset >= header->names_size) ||
+            (records[i].name_len >=
+            header->names_size - records[i].name_offset) ||
+            (names[records[i].name_offset + records[i].name_len] != '\0') ||
+            (records[i].first_child > header->num_records) ||
+            (records[i].num_children >
+            header->num_records - records[i].first_child))
+            return (1);
+    }
+    return (0);
+}
+
+/* Load (memory-map) a previous index
+   - a missing or invalid index (or one written with other crawling
+     options) is considered empty
+   - returns 0 (success) or 1 (failure) */
+int
+load_crawl_index(const char *path, const struct program_options *options)
+{
+    assert(path != NULL);
+    assert(options != NULL);
+    assert(crawl_index.map == NULL);
+
+    crawl_index.options = crawl_index_options(options);
+
+    struct stat st;
+    int fd = -1;
+
+    if((fd = open(path, O_RDONLY)) < 0) {
+        if(errno == ENOENT)
+            return (0);
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return (1);
+    }
+    if(fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        close(fd);
+        return (1);
+    }
+    if(st.st_size == 0) {
+        close(fd);
+        return (0);
+    }
+
+    crawl_index.map_size = (size_t)st.st_size;
+    if((crawl_index.map = mmap(NULL, crawl_index.map_size, PROT_READ,
+        MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        crawl_index.map = NULL;
+        close(fd);
+        return (1);
+    }
+    close(fd);
+
+    if(crawl_index_check(crawl_index.map, crawl_index.map_size) != 0) {
+        fprintf(stderr, "%s: invalid index, ignoring it\n", path);
+        munmap(crawl_index.map, crawl_index.map_size);
+        crawl_index.map = NULL;
+        return (0);
+    }
+
+    const struct crawl_index_header *header = crawl_index.map;
+    if(header->options != crawl_index.options) {
+        fprintf(stderr, "%s: index written with other crawling options, "
+            "ignoring it\n", path);
+        munmap(crawl_index.map, crawl_index.map_size);
+        crawl_index.map = NULL;
+        return (0);
+    }
+
+    crawl_index.records = (const struct crawl_index_record *)&header[1];
+    crawl_index.num_records = header->num_records;
+    crawl_index.num_roots = header->num_roots;
+    crawl_index.names =
+        (const char *)&crawl_index.records[crawl_index.num_records];
+    crawl_index.names_size = header->names_size;
+    return (0);
+}
+
+/* Look a name up within a range of records
+   - returns NULL if not found */
+static const struct crawl_index_record *
+crawl_index_lookup(const struct crawl_index_record *records, uint64_t num,
+    const char *name)
+{
+    assert((records != NULL) || (num == 0));
+    assert(name != NULL);
+
+    size_t name_len = strlen(name);
+    uint64_t low = 0;
+    uint64_t high = num;
+
+    while(low < high) {
+        uint64_t middle = low + ((high - low) / 2);
+        int res = crawl_index_cmp(&crawl_index.names
+            [records[middle].name_offset], records[middle].name_len,
+            name, name_len);
+        if(res == 0)
+            return (&records[middle]);
+        if(res < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return (NULL);
+}
+
+/* Find a root (path given as an argument) within previous index
+   - returns NULL if not found */
+const struct crawl_index_record *
+crawl_index_root(const char *path)
+{
+    assert(path != NULL);
+
+    if(crawl_index.map == NULL)
+        return (NULL);
+    return (crawl_index_lookup(crawl_index.records, crawl_index.num_roots,
+        path));
+}
+
+/* Find a directory's child within previous index
+   - returns NULL if not found (or if dir is NULL) */
+const struct crawl_index_record *
+crawl_index_child(const struct crawl_index_record *dir, const char *name)
+{
+    assert(name != NULL);
+
+    if(dir == NULL)
+        return (NULL);
+    return (crawl_index_lookup(crawl_index_children(dir), dir->num_children,
+        name));
+}
+
+/* Return the first child of a directory within previous index (see
+   record->num_children) */
+const struct crawl_index_record *
+crawl_index_children(const struct crawl_index_record *dir)
+{
+    assert(dir != NULL);
+    assert(crawl_index.map != NULL);
+
+    return (&crawl_index.records[dir->first_child]);
+}
+
+/* Return the name of a record of previous index */
+const char *
+crawl_index_name(const struct crawl_index_record *record)
+{
+    assert(record != NULL);
+    assert(crawl_index.map != NULL);
+
+    return (&crawl_index.names[record->name_offset]);
+}
+
+/* Fill a stat structure from a record of previous index ; only fields
+   stored within the index are set */
+void
+crawl_index_stat(const struct crawl_index_record *record, struct stat *st)
+{
+    assert(record != NULL);
+    assert(st != NULL);
+
+    memset(st, 0, sizeof(struct stat));
+    st->st_size = (off_t)record->size;
+    st->st_mtime = (time_t)record->mtime;
+#if defined(st_mtime_nsec)
+    st_mtime_nsec(st) = (long)record->mtime_nsec;
+#endif
+    st->st_ino = (ino_t)record->ino;
+    st->st_dev = (dev_t)record->dev;
+    st->st_mode = (mode_t)record->mode;
+    return;
+}
+
+/* Check if a file or directory has not changed since previous index
+   - returns 1 if it is unchanged, else 0 */
+int
+crawl_index_unchanged(const struct crawl_index_record *record,
+    struct stat *st)
+{
+    assert(st != NULL);
+
+    if(record == NULL)
+        return (0);
+    return ((record->size == (uint64_t)get_size(st)) &&
+        (record->mtime == (int64_t)st->st_mtime) &&
+#if defined(st_mtime_nsec)
+        (record->mtime_nsec == (int64_t)st_mtime_nsec(st)) &&
+#endif
+        (record->ino == (uint64_t)st->st_ino) &&
+        (record->dev == (uint64_t)st->st_dev) &&
+        ((record->mode & S_IFMT) == (st->st_mode & S_IFMT)) &&
+        !(record->flags & CRAWL_INDEX_INCOMPLETE));
+}
+
+/* Add a file or directory to the index being built
+   - if parent is NULL, name is a root path
+   - returns NULL if memory cannot be allocated */
+struct crawl_index_node *
+crawl_index_add(struct crawl_index_node *parent, const char *name,
+    struct stat *st)
+{
+    assert(name != NULL);
+    assert(st != NULL);
+
+    struct crawl_index_node *node = NULL;
+    size_t name_len = strlen(name);
+
+    if(!crawl_index.initialized) {
+        init_arena(&crawl_index.nodes, 0);
+        crawl_index.initialized = 1;
+    }
+
+    if((node = arena_alloc(&crawl_index.nodes,
+        sizeof(struct crawl_index_node))) == NULL)
+        return (NULL);
+
+    /* names coming from previous index do not need to be copied */
+    if((crawl_index.map != NULL) && (name >= crawl_index.names) &&
+        (name < crawl_index.names + crawl_index.names_size))
+        node->name = name;
+    else if((node->name = arena_strndup(&crawl_index.nodes, name,
+        name_len)) == NULL)
+        return (NULL);
+
+    node->record.size = (uint64_t)get_size(st);
+    node->record.mtime = (int64_t)st->st_mtime;
+#if defined(st_mtime_nsec)
+    node->record.mtime_nsec = (int64_t)st_mtime_nsec(st);
+#else
+    node->record.mtime_nsec = 0;
+#endif
+    node->record.ino = (uint64_t)st->st_ino;
+    node->record.dev = (uint64_t)st->st_dev;
+    node->record.name_offset = 0;
+    node->record.first_child = 0;
+    node->record.num_children = 0;
+    node->record.name_len = (uint32_t)name_len;
+    node->record.mode = (uint32_t)st->st_mode;
+    node->record.flags = 0;
+    node->first_childp = NULL;
+
+    if(parent != NULL) {
+        node->next_siblingp = parent->first_childp;
+        parent->first_childp = node;
+        parent->record.num_children++;
+    }
+    else {
+        node->next_siblingp = crawl_index.roots;
+        crawl_index.roots = node;
+    }
+    crawl_index.num_nodes++;
+    return (node);
+}
+
+/* Sort nodes by name */
+static int
+crawl_index_sort_nodes(const void *a, const void *b)
+{
+    assert(a != NULL);
+    assert(b != NULL);
+
+    const struct crawl_index_node *node_a =
+        *((const struct crawl_index_node * const *)a);
+    const struct crawl_index_node *node_b =
+        *((const struct crawl_index_node * const *)b);
+
+    return (crawl_index_cmp(node_a->name, node_a->record.name_len,
+        node_b->name, node_b->record.name_len));
+}
+
+/* Save the index being built, replacing previous one
+   - returns 0 (success) or 1 (failure) */
+int
+save_crawl_index(const char *path)
+{
+    assert(path != NULL);
+
+    struct crawl_index_node **order = NULL;
+    struct crawl_index_node *node = NULL;
+    struct crawl_index_header header;
+    struct out_buffer buffer;
+    char *tmp_path = NULL;
+    uint64_t num_roots = 0;
+    uint64_t num_ordered = 0;
+    uint64_t names_size = 0;
+    uint64_t i;
+    int fd = -1;
+    int error = 0;
+
+    /* lay nodes out, grouped by directory and sorted by name */
+    if_not_malloc(order, sizeof(struct crawl_index_node *) *
+        max(crawl_index.num_nodes, 1),
+        return (1);
+    )
+    for(node = crawl_index.roots ; node != NULL ; node = node->next_siblingp)
+        order[num_ordered++] = node;
+    num_roots = num_ordered;
+    qsort(&order[0], num_roots, sizeof(struct crawl_index_node *),
+        &crawl_index_sort_nodes);
+    for(i = 0 ; i < num_ordered ; i++) {
+        struct crawl_index_node *child = order[i]->first_childp;
+        order[i]->record.first_child = num_ordered;
+        for( ; child != NULL ; child = child->next_siblingp)
+            order[num_ordered++] = child;
+        qsort(&order[order[i]->record.first_child],
+            order[i]->record.num_children, sizeof(struct crawl_index_node *),
+            &crawl_index_sort_nodes);
+        order[i]->record.name_offset = names_size;
+        names_size += order[i]->record.name_len + 1;
+    }
+    assert(num_ordered == crawl_index.num_nodes);
+
+    /* write to a temporary file, then replace previous index */
+    size_t malloc_size = strlen(path) + 1 + 6 + 1;
+    if_not_malloc(tmp_path, malloc_size,
+        free(order);
+        return (1);
+    )
+    snprintf(tmp_path, malloc_size, "%s.XXXXXX", path);
+    if((fd = mkstemp(tmp_path)) < 0) {
+        fprintf(stderr, "%s: %s\n", tmp_path, strerror(errno));
+        free(tmp_path);
+        free(order);
+        return (1);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CRAWL_INDEX_MAGIC, sizeof(header.magic));
+    header.version = CRAWL_INDEX_VERSION;
+    header.record_size = sizeof(struct crawl_index_record);
+    header.byte_order = CRAWL_INDEX_BYTE_ORDER;
+    header.num_records = num_ordered;
+    header.num_roots = num_roots;
+    header.names_size = names_size;
+    header.options = crawl_index.options;
+
+    init_out_buffer(&buffer, fd, OUTPUT_MAX_BUFFER_SIZE);
+    error = out_buffer_write(&buffer, (char *)&header, sizeof(header));
+    for(i = 0 ; (i < num_ordered) && (!error) ; i++)
+        error = out_buffer_write(&buffer, (char *)&order[i]->record,
+            sizeof(struct crawl_index_record));
+    for(i = 0 ; (i < num_ordered) && (!error) ; i++)
+        error = out_buffer_write(&buffer, order[i]->name,
+            order[i]->record.name_len + 1);
+    if(!error)
+        error = out_buffer_flush(&buffer);
+    uninit_out_buffer(&buffer);
+
+    if(close(fd) != 0)
+        error = 1;
+    if((!error) && (rename(tmp_path, path) != 0)) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        error = 1;
+    }
+    if(error)
+        unlink(tmp_path);
+
+    free(tmp_path);
+    free(order);
+    return (error);
+}
+
+/* Release previous index and the index being built */
+void
+uninit_crawl_index(void)
+{
+    if(crawl_index.map != NULL)
+        munmap(crawl_index.map, crawl_index.map_size);
+    crawl_index.map = NULL;
+    crawl_index.map_size = 0;
+    crawl_index.records = NULL;
+    crawl_index.num_records = 0;
+    crawl_index.num_roots = 0;
+    crawl_index.names = NULL;
+    crawl_index.names_size = 0;
+
+    if(crawl_index.initialized)
+        uninit_arena(&crawl_index.nodes);
+    crawl_index.initialized = 0;
+    crawl_index.roots = NULL;
+    crawl_index.num_nodes = 0;
+    return;
+}
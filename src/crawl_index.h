@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _CRAWL_INDEX_H
+#define _CRAWL_INDEX_H
+
+#include "types.h"
+#include "options.h"
+
+/* uint32_t, uint64_t, int64_t */
+#include <stdint.h>
+
+/* struct stat */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define CRAWL_INDEX_MAGIC       "FPARTIDX"
+#define CRAWL_INDEX_VERSION     2
+#define CRAWL_INDEX_BYTE_ORDER  0x0102030405060708ULL
+
+/* Index file header. An index file is made of a header, followed by an array
+   of records and by their names (each one ending with '\0'). Records are
+   grouped by directory: root records come first, then children of a given
+   directory are contiguous. Roots and children are sorted by name so they
+   can be looked up using a binary search. The file is memory-mapped when
+   read and is not portable across architectures */
+struct crawl_index_header {
+    char magic[8];                  /* CRAWL_INDEX_MAGIC */
+    uint32_t version;               /* CRAWL_INDEX_VERSION */
+    uint32_t record_size;           /* sizeof(struct crawl_index_record) */
+    uint64_t byte_order;            /* CRAWL_INDEX_BYTE_ORDER */
+    uint64_t num_records;
+    uint64_t num_roots;
+    uint64_t names_size;            /* size of names, in bytes */
+    uint64_t options;               /* hash of crawling options
+                                       (see crawl_index_options()) */
+};
+
+/* Record flags */
+#define CRAWL_INDEX_INCOMPLETE  1   /* directory has not been fully read */
+
+/* A file or directory, as found when crawling */
+struct crawl_index_record {
+    uint64_t size;                  /* size, see get_size() */
+    int64_t mtime;                  /* modification time */
+    int64_t mtime_nsec;             /* and its nanoseconds, if available */
+    uint64_t ino;                   /* inode */
+    uint64_t dev;                   /* device */
+    uint64_t name_offset;           /* name (path for roots), within names */
+    uint64_t first_child;           /* first child record (directories) */
+    uint32_t num_children;          /* number of children (directories) */
+    uint32_t name_len;              /* name length */
+    uint32_t mode;                  /* st_mode */
+    uint32_t flags;                 /* CRAWL_INDEX_* */
+};
+
+/* A file or directory of the index being built */
+struct crawl_index_node;
+struct crawl_index_node {
+    struct crawl_index_record record;   /* name_offset and first_child are
+                                           computed when saving */
+    const char *name;
+
+    struct crawl_index_node *first_childp;
+    struct crawl_index_node *next_siblingp;
+};
+
+int load_crawl_index(const char *path,
+    const struct program_options *options);
+int save_crawl_index(const char *path);
+void uninit_crawl_index(void);
+const struct crawl_index_record *crawl_index_root(const char *path);
+const struct crawl_index_record *crawl_index_child(
+    const struct crawl_index_record *dir, const char *name);
+const struct crawl_index_record *crawl_index_children(
+    const struct crawl_index_record *dir);
+const char *crawl_index_name(const struct crawl_index_record *record);
+void crawl_index_stat(const struct crawl_index_record *record,
+    struct stat *st);
+int crawl_index_unchanged(const struct crawl_index_record *record,
+    struct stat *st);
+struct crawl_index_node *crawl_index_add(struct crawl_index_node *parent,
+    const char *name, struct stat *st);
+
+#endif /* _CRAWL_INDEX_H */
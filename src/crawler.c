@@ -0,0 +1,993 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "options.h"
+#include "file_entry.h"
+#include "crawl_index.h"
+#include "crawler.h"
+
+/* fprintf(3) */
+#include <stdio.h>
+
+/* strerror(3), strlen(3), strrchr(3), memcpy(3), memmove(3) */
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* malloc(3) */
+#include <stdlib.h>
+
+/* fstatat(2) */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* open(2) */
+#include <fcntl.h>
+
+/* close(2) */
+#include <unistd.h>
+
+/* fdopendir(3), readdir(3), closedir(3) */
+#include <dirent.h>
+
+/* pthread(3) */
+#include <pthread.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/****************************
+ Parallel crawling functions
+ ****************************/
+
+/* Entry to produce for a directory, once its whole subtree has been crawled */
+#define CRAWL_ENTRY_NONE        0   /* do not add directory */
+#define CRAWL_ENTRY_EMPTY       1   /* add directory with a null size */
+#define CRAWL_ENTRY_FILES       2   /* add directory with the size of the
+                                       files it directly contains (-E) */
+#define CRAWL_ENTRY_RECURSIVE   3   /* add directory with its recursive size */
+#define CRAWL_ENTRY_DEPTH       4   /* -d depth reached, add directory with its
+                                       recursive size if its name is valid */
+
+/* Directory flags */
+#define CRAWL_SIZING            1   /* only compute directory size */
+#define CRAWL_NODESCEND         2   /* do not descend (mountpoint with -b) */
+#define CRAWL_UNCHANGED         4   /* unchanged since previous index (-I),
+                                       read its entries from that index */
+
+/* A directory to crawl. Directories are kept until their whole subtree has
+   been crawled, to sum sizes up (post-order) and to detect loops */
+struct crawl_dir;
+struct crawl_dir {
+    short level;                    /* depth, root being 0 */
+    unsigned char flags;            /* CRAWL_SIZING, CRAWL_NODESCEND */
+    unsigned char entry;            /* CRAWL_ENTRY_* */
+    dev_t dev;                      /* device and inode, for loop */
+    ino_t ino;                      /* detection */
+    dev_t root_dev;                 /* root device, for option -b */
+    fsize_t files_size;             /* size of files directly contained */
+    fsize_t size;                   /* recursive size */
+    unsigned int refs;              /* pending crawls: self + children */
+    struct crawl_dir *parentp;      /* parent directory (NULL for root) */
+    const struct crawl_index_record *index_old; /* within previous index */
+    struct crawl_index_node *index_node;        /* within new index */
+    size_t name_offset;             /* name, within path */
+    size_t pathlen;                 /* path length */
+    char path[];                    /* path */
+};
+
+/* A file found in the directory being crawled */
+struct crawl_file {
+    size_t name_offset;             /* name, within worker's names buffer */
+    fsize_t size;                   /* size in bytes */
+    struct stat st;                 /* status, kept for option -I */
+};
+
+struct crawler;
+
+/* A worker thread, with its own queue of directories to crawl. Owner pops
+   directories from the end of its queue (depth first, to keep the number of
+   pending directories low) while other workers steal them from its beginning
+   (larger subtrees) */
+struct crawl_worker {
+    pthread_t thread;
+    struct crawler *crawler;
+
+    pthread_mutex_t lock;           /* protects queue */
+    struct crawl_dir **queue;
+    size_t queue_first;             /* first queued directory */
+    size_t queue_last;              /* last queued directory + 1 */
+    size_t queue_size;              /* allocated slots */
+
+    struct crawl_file *files;       /* files of current directory */
+    size_t num_files;
+    size_t files_size;              /* allocated slots */
+    char *names;                    /* their names */
+    size_t names_used;
+    size_t names_size;              /* allocated bytes */
+    char *path;                     /* path building buffer */
+    size_t path_size;               /* allocated bytes */
+};
+
+/* Crawler state, shared among workers */
+struct crawler {
+    struct program_options *options;
+    unsigned char index;            /* build an index (option -I) */
+
+    pthread_mutex_t lock;           /* protects file entries, count, error
+                                       and crawl_dir sizes and refs */
+    struct file_entry **head;
+    fnum_t *count;
+    int error;                      /* critical error occurred */
+
+    pthread_mutex_t pool_lock;      /* protects counters below */
+    pthread_cond_t pool_cond;       /* signaled when work is available or
+                                       crawling is over */
+    fnum_t queued;                  /* directories waiting in queues */
+    fnum_t active;                  /* directories being crawled */
+    unsigned char done;             /* crawling over */
+
+    struct crawl_worker *workers;
+    unsigned int num_workers;
+};
+
+/* Allocate a new directory to crawl, from its parent and name
+   - if parent is NULL, name is the root path
+   - returns NULL if error */
+static struct crawl_dir *
+new_crawl_dir(struct crawl_dir *parent, const char *name, struct stat *st)
+{
+    assert(name != NULL);
+    assert(st != NULL);
+
+    struct crawl_dir *dir = NULL;
+    size_t name_len = strlen(name);
+    size_t prefix_len = 0;
+    unsigned char add_slash = 0;
+
+    if(parent != NULL) {
+        prefix_len = parent->pathlen;
+        /* do not double an ending slash, as fts(3) does */
+        add_slash = ((prefix_len == 0) ||
+            (parent->path[prefix_len - 1] != '/'));
+    }
+
+    if_not_malloc(dir, sizeof(struct crawl_dir) + prefix_len + add_slash +
+        name_len + 1,
+        return (NULL);
+    )
+
+    if(parent != NULL)
+        memcpy(dir->path, parent->path, prefix_len);
+    if(add_slash)
+        dir->path[prefix_len] = '/';
+    memcpy(&dir->path[prefix_len + add_slash], name, name_len + 1);
+    dir->pathlen = prefix_len + add_slash + name_len;
+    dir->name_offset = prefix_len + add_slash;
+    /* root name is its last path component, as fts(3) does */
+    if(parent == NULL) {
+        char *last_slash = strrchr(dir->path, '/');
+        if((last_slash != NULL) && (dir->pathlen > 1))
+            dir->name_offset = last_slash - dir->path + 1;
+    }
+
+    dir->level = (parent != NULL) ? parent->level + 1 : 0;
+    dir->flags = 0;
+    dir->entry = CRAWL_ENTRY_NONE;
+    dir->dev = st->st_dev;
+    dir->ino = st->st_ino;
+    dir->root_dev = (parent != NULL) ? parent->root_dev : st->st_dev;
+    dir->files_size = 0;
+    dir->size = 0;
+    dir->refs = 1;
+    dir->parentp = parent;
+    dir->index_old = NULL;
+    dir->index_node = NULL;
+
+    return (dir);
+}
+
+/* Check if a directory is one of the ancestors of dir (or dir itself)
+   - returns 1 if a loop is detected, else 0 */
+static int
+crawl_loop(const struct crawl_dir *dir, const struct stat *st)
+{
+    assert(st != NULL);
+
+    while(dir != NULL) {
+        if((dir->dev == st->st_dev) && (dir->ino == st->st_ino))
+            return (1);
+        dir = dir->parentp;
+    }
+    return (0);
+}
+
+/* Build path of an entry of directory dir within worker's path buffer
+   - returns a pointer to the path or NULL if error */
+static char *
+crawl_path(struct crawl_worker *worker, const struct crawl_dir *dir,
+    const char *name)
+{
+    assert(worker != NULL);
+    assert(dir != NULL);
+    assert(name != NULL);
+
+    size_t name_len = strlen(name);
+    unsigned char add_slash = ((dir->pathlen == 0) ||
+        (dir->path[dir->pathlen - 1] != '/'));
+    /* count an ending '/' (see option -e) and '\0' */
+    size_t path_size = dir->pathlen + add_slash + name_len + 1 + 1;
+
+    if(path_size > worker->path_size) {
+        if_not_realloc(worker->path, path_size,
+            worker->path_size = 0;
+            return (NULL);
+        )
+        worker->path_size = path_size;
+    }
+
+    memcpy(worker->path, dir->path, dir->pathlen);
+    if(add_slash)
+        worker->path[dir->pathlen] = '/';
+    memcpy(&worker->path[dir->pathlen + add_slash], name, name_len + 1);
+
+    return (worker->path);
+}
+
+/* Remember a file found in the directory being crawled
+   - returns 0 (success) or 1 (failure) */
+static int
+crawl_add_file(struct crawl_worker *worker, const char *name,
+    struct stat *st)
+{
+    assert(worker != NULL);
+    assert(name != NULL);
+    assert(st != NULL);
+
+    size_t name_size = strlen(name) + 1;
+
+    if(worker->num_files >= worker->files_size) {
+        size_t files_size = (worker->files_size > 0) ?
+            worker->files_size * 2 : 256;
+        if_not_realloc(worker->files, sizeof(struct crawl_file) * files_size,
+            worker->files_size = 0;
+            return (1);
+        )
+        worker->files_size = files_size;
+    }
+    if(worker->names_used + name_size > worker->names_size) {
+        size_t names_size = max(worker->names_size * 2,
+            worker->names_used + name_size);
+        names_size = max(names_size, 4096);
+        if_not_realloc(worker->names, names_size,
+            worker->names_size = 0;
+            return (1);
+        )
+        worker->names_size = names_size;
+    }
+
+    memcpy(&worker->names[worker->names_used], name, name_size);
+    worker->files[worker->num_files].name_offset = worker->names_used;
+    worker->files[worker->num_files].size = get_size(st);
+    if(worker->crawler->index)
+        worker->files[worker->num_files].st = *st;
+    worker->names_used += name_size;
+    worker->num_files++;
+
+    return (0);
+}
+
+/* Add or display an entry, crawler lock must be held
+   - returns 0 (success) or 1 (failure) */
+static int
+crawl_handle_entry(struct crawler *crawler, char *path, fsize_t size)
+{
+    assert(crawler != NULL);
+    assert(path != NULL);
+
+    if(handle_file_entry(crawler->head, path, size, crawler->options) == 0) {
+        (*crawler->count)++;
+        return (0);
+    }
+
+    fprintf(stderr, "%s(): cannot add file entry\n", __func__);
+    crawler->error = 1;
+    return (1);
+}
+
+/* Release a reference on a directory ; when its whole subtree has been
+   crawled, add its entry (if needed), sum its size up to its parent and
+   release it too. Crawler lock must be held */
+static void
+crawl_release_dir(struct crawler *crawler, struct crawl_dir *dir)
+{
+    assert(crawler != NULL);
+
+    while(dir != NULL) {
+        struct crawl_dir *parent = dir->parentp;
+
+        assert(dir->refs > 0);
+        if(--dir->refs > 0)
+            return;
+
+        /* with option -I, unchanged directories are not added */
+        if((dir->entry != CRAWL_ENTRY_NONE) && (!crawler->error) &&
+            !(dir->flags & CRAWL_UNCHANGED)) {
+            fsize_t size = 0;
+
+            if(dir->entry == CRAWL_ENTRY_FILES)
+                size = dir->files_size;
+            else if(dir->entry != CRAWL_ENTRY_EMPTY)
+                size = dir->size;
+
+            /* add slash if requested and necessary */
+            if((crawler->options->add_slash == OPT_ADDSLASH) &&
+                (dir->pathlen > 0) &&
+                (dir->path[dir->pathlen - 1] != '/')) {
+                char *entry_path = NULL;
+                if_not_malloc(entry_path, dir->pathlen + 1 + 1,
+                    crawler->error = 1;
+                )
+                if(entry_path != NULL) {
+                    snprintf(entry_path, dir->pathlen + 1 + 1, "%s/",
+                        dir->path);
+                    crawl_handle_entry(crawler, entry_path, size);
+                    free(entry_path);
+                }
+            }
+            else
+                crawl_handle_entry(crawler, dir->path, size);
+        }
+
+        if(parent != NULL)
+            parent->size += dir->size;
+        free(dir);
+        dir = parent;
+    }
+}
+
+/* Queue a directory to be crawled by a worker */
+static void
+crawl_push_dir(struct crawl_worker *worker, struct crawl_dir *dir)
+{
+    assert(worker != NULL);
+    assert(dir != NULL);
+
+    struct crawler *crawler = worker->crawler;
+
+    pthread_mutex_lock(&crawler->pool_lock);
+    crawler->queued++;
+    pthread_cond_signal(&crawler->pool_cond);
+    pthread_mutex_unlock(&crawler->pool_lock);
+
+    pthread_mutex_lock(&worker->lock);
+    if(worker->queue_last >= worker->queue_size) {
+        /* reuse free slots at the beginning of the queue first */
+        if(worker->queue_first > 0) {
+            memmove(&worker->queue[0], &worker->queue[worker->queue_first],
+                sizeof(struct crawl_dir *) *
+                (worker->queue_last - worker->queue_first));
+            worker->queue_last -= worker->queue_first;
+            worker->queue_first = 0;
+        }
+        else {
+            size_t queue_size = (worker->queue_size > 0) ?
+                worker->queue_size * 2 : 256;
+            struct crawl_dir **queue = worker->queue;
+            if_not_realloc(queue, sizeof(struct crawl_dir *) * queue_size,
+                /* keep crawling, directory will be ignored */
+                pthread_mutex_unlock(&worker->lock);
+                pthread_mutex_lock(&crawler->lock);
+                crawler->error = 1;
+                crawl_release_dir(crawler, dir);
+                pthread_mutex_unlock(&crawler->lock);
+                pthread_mutex_lock(&crawler->pool_lock);
+                crawler->queued--;
+                pthread_mutex_unlock(&crawler->pool_lock);
+                return;
+            )
+            worker->queue = queue;
+            worker->queue_size = queue_size;
+        }
+    }
+    worker->queue[worker->queue_last++] = dir;
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/* Get a directory to crawl, either from worker's own queue or from
+   another worker's one
+   - returns NULL if no directory is available */
+static struct crawl_dir *
+crawl_pop_dir(struct crawl_worker *worker)
+{
+    assert(worker != NULL);
+
+    struct crawler *crawler = worker->crawler;
+    struct crawl_dir *dir = NULL;
+    unsigned int i;
+
+    /* own queue first, from its end */
+    pthread_mutex_lock(&worker->lock);
+    if(worker->queue_last > worker->queue_first)
+        dir = worker->queue[--worker->queue_last];
+    if(worker->queue_last == worker->queue_first)
+        worker->queue_first = worker->queue_last = 0;
+    pthread_mutex_unlock(&worker->lock);
+
+    /* then, steal from other workers, from the beginning of their queue */
+    for(i = 1 ; (dir == NULL) && (i < crawler->num_workers) ; i++) {
+        struct crawl_worker *victim =
+            &crawler->workers[(worker - crawler->workers + i) %
+            crawler->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        if(victim->queue_last > victim->queue_first)
+            dir = victim->queue[victim->queue_first++];
+        if(victim->queue_last == victim->queue_first)
+            victim->queue_first = victim->queue_last = 0;
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    if(dir != NULL) {
+        pthread_mutex_lock(&crawler->pool_lock);
+        crawler->queued--;
+        crawler->active++;
+        pthread_mutex_unlock(&crawler->pool_lock);
+    }
+    return (dir);
+}
+
+/* Crawl a single directory: queue its sub-directories, add its files and
+   decide what entry to produce for the directory itself. This mimics what
+   init_file_entries() does with fts(3), based on the directory listing */
+static void
+crawl_directory(struct crawl_worker *worker, struct crawl_dir *dir)
+{
+    assert(worker != NULL);
+    assert(dir != NULL);
+
+    struct crawler *crawler = worker->crawler;
+    struct program_options *options = crawler->options;
+    unsigned char sizing = (dir->flags & CRAWL_SIZING);
+    unsigned char readable = 1;
+    unsigned char incomplete = 0;       /* directory has not been fully read */
+    unsigned char empty = 1;            /* directory is empty */
+    unsigned char dirsfound = 0;        /* sub-directories have been found */
+    fsize_t files_size = 0;             /* size of files found */
+    int error = 0;
+    size_t i;
+
+    worker->num_files = 0;
+    worker->names_used = 0;
+
+    pthread_mutex_lock(&crawler->lock);
+    error = crawler->error;
+    pthread_mutex_unlock(&crawler->lock);
+
+    if((!error) && !(dir->flags & CRAWL_NODESCEND)) {
+        int dir_fd = -1;
+        DIR *dirp = NULL;
+        const struct crawl_index_record *index_entries = NULL;
+        size_t index_num_entries = 0;
+
+        /* unchanged directory (option -I), its entries are those of previous
+           index. Files are not examined again, sub-directories are */
+        if(dir->flags & CRAWL_UNCHANGED) {
+            index_entries = crawl_index_children(dir->index_old);
+            index_num_entries = dir->index_old->num_children;
+        }
+        else if(((dir_fd = open(dir->path, O_RDONLY | O_DIRECTORY)) < 0) ||
+            ((dirp = fdopendir(dir_fd)) == NULL)) {
+            fprintf(stderr, "%s: %s\n", dir->path, strerror(errno));
+            if(dir_fd >= 0)
+                close(dir_fd);
+            readable = 0;
+            incomplete = 1;
+        }
+
+        while(((dirp != NULL) || (index_entries != NULL)) && (!error)) {
+            const char *name = NULL;
+            struct stat st;
+            char *path = NULL;
+
+            if(index_entries != NULL) {
+                if(index_num_entries == 0)
+                    break;
+                name = crawl_index_name(index_entries);
+                crawl_index_stat(index_entries, &st);
+                index_entries++;
+                index_num_entries--;
+
+                if(S_ISDIR(st.st_mode)) {
+                    if((path = crawl_path(worker, dir, name)) == NULL) {
+                        error = 1;
+                        break;
+                    }
+                    if(((options->follow_symbolic_links ==
+                        OPT_FOLLOWSYMLINKS) ?
+                        stat(path, &st) : lstat(path, &st)) != 0) {
+                        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+                        empty = 0;
+                        continue;
+                    }
+                }
+            }
+            else {
+                struct dirent *dp = NULL;
+
+                errno = 0;
+                if((dp = readdir(dirp)) == NULL) {
+                    if(errno != 0) {
+                        fprintf(stderr, "%s: %s\n", dir->path,
+                            strerror(errno));
+                        incomplete = 1;
+                    }
+                    break;
+                }
+                name = dp->d_name;
+
+                /* ignore "." and ".." */
+                if((name[0] == '.') && ((name[1] == '\0') ||
+                    ((name[1] == '.') && (name[2] == '\0'))))
+                    continue;
+
+                if(fstatat(dir_fd, name, &st,
+                    (options->follow_symbolic_links == OPT_FOLLOWSYMLINKS) ?
+                    0 : AT_SYMLINK_NOFOLLOW) != 0) {
+                    int stat_errno = errno;
+                    /* dangling symbolic link, handle it as a file */
+                    if((options->follow_symbolic_links !=
+                        OPT_FOLLOWSYMLINKS) ||
+                        (fstatat(dir_fd, name, &st,
+                        AT_SYMLINK_NOFOLLOW) != 0)) {
+                        if((path = crawl_path(worker, dir, name)) == NULL) {
+                            error = 1;
+                            break;
+                        }
+                        fprintf(stderr, "%s: %s\n", path,
+                            strerror(stat_errno));
+                        empty = 0;
+                        continue;
+                    }
+                }
+            }
+
+            if(S_ISDIR(st.st_mode)) {
+                struct crawl_dir *subdir = NULL;
+
+                if(crawl_loop(dir, &st)) {
+                    if((path = crawl_path(worker, dir, name)) == NULL) {
+                        error = 1;
+                        break;
+                    }
+                    fprintf(stderr, "%s: filesystem loop detected\n", path);
+                    continue;
+                }
+
+                empty = 0;
+                dirsfound = 1;
+
+                /* check for name validity regarding exclude options */
+                if((!sizing) && (!valid_filename(name, options, 0))) {
+                    if(options->verbose >= OPT_VERBOSE) {
+                        if((path = crawl_path(worker, dir, name)) ==
+                            NULL) {
+                            error = 1;
+                            break;
+                        }
+                        fprintf(stderr, "Skipping directory: '%s'\n", path);
+                    }
+                    continue;
+                }
+
+                if((subdir = new_crawl_dir(dir, name, &st)) == NULL) {
+                    error = 1;
+                    break;
+                }
+                subdir->flags = dir->flags & CRAWL_SIZING;
+                if((options->cross_fs_boundaries == OPT_NOCROSSFSBOUNDARIES) &&
+                    (st.st_dev != dir->root_dev))
+                    subdir->flags |= CRAWL_NODESCEND;
+                /* if dir_depth requested and reached, do not add descendants
+                   but crawl them to compute directory size */
+                if((!sizing) && (options->dir_depth != OPT_NODIRDEPTH) &&
+                    (subdir->level >= options->dir_depth)) {
+                    subdir->flags |= CRAWL_SIZING;
+                    subdir->entry = CRAWL_ENTRY_DEPTH;
+                }
+
+                pthread_mutex_lock(&crawler->lock);
+                dir->refs++;
+                if(crawler->index) {
+                    /* record sub-directory and look it up within previous
+                       index */
+                    if((subdir->index_node = crawl_index_add(dir->index_node,
+                        name, &st)) == NULL)
+                        crawler->error = 1;
+                    else if(subdir->flags & CRAWL_NODESCEND)
+                        subdir->index_node->record.flags |=
+                            CRAWL_INDEX_INCOMPLETE;
+                    subdir->index_old = crawl_index_child(dir->index_old,
+                        name);
+                    if(crawl_index_unchanged(subdir->index_old, &st))
+                        subdir->flags |= CRAWL_UNCHANGED;
+                }
+                pthread_mutex_unlock(&crawler->lock);
+                crawl_push_dir(worker, subdir);
+            }
+            else {
+                fsize_t file_size = get_size(&st);
+
+                empty = 0;
+                files_size += file_size;
+                if((!sizing) &&
+                    (crawl_add_file(worker, name, &st) != 0)) {
+                    error = 1;
+                    break;
+                }
+            }
+        }
+
+        if(dirp != NULL)
+            closedir(dirp);
+    }
+
+    /* decide which entry to produce for current directory
+       (see FTS_DNR and FTS_DP handling in init_file_entries()) */
+    if(dir->entry == CRAWL_ENTRY_DEPTH) {
+        if(!valid_filename(&dir->path[dir->name_offset], options, 1)) {
+            if(options->verbose >= OPT_VERBOSE)
+                fprintf(stderr, "Skipping directory: '%s'\n", dir->path);
+            dir->entry = CRAWL_ENTRY_NONE;
+        }
+    }
+    else if((!sizing) && (!error)) {
+        unsigned char addme = 0;
+
+        /* un-readable directories are added as empty ones with -zz */
+        if(!readable) {
+            if(options->dirs_include >= OPT_DNREMPTY) {
+                empty = 1;
+                dirsfound = 0;
+                addme = 1;
+            }
+        }
+        else
+            addme = 1;
+
+        /* add files, unless packing directories */
+        if(readable && (!((options->dirs_only == OPT_DIRSONLY) ||
+            ((options->leaf_dirs == OPT_LEAFDIRS) && (!dirsfound))))) {
+            /* check for name validity regarding include/exclude options */
+            for(i = 0 ; i < worker->num_files ; i++) {
+                char *name = &worker->names[worker->files[i].name_offset];
+                if(valid_filename(name, options, 1))
+                    continue;
+                if(options->verbose >= OPT_VERBOSE) {
+                    char *path = crawl_path(worker, dir, name);
+                    if(path != NULL)
+                        fprintf(stderr, "Skipping file: '%s'\n", path);
+                }
+                worker->files[i].name_offset = (size_t)-1;
+            }
+
+            /* add or display them at once */
+            pthread_mutex_lock(&crawler->lock);
+            for(i = 0 ; (i < worker->num_files) && (!crawler->error) ; i++) {
+                char *name = NULL;
+                char *path = NULL;
+                if(worker->files[i].name_offset == (size_t)-1)
+                    continue;
+                name = &worker->names[worker->files[i].name_offset];
+                /* with option -I, record file and add it only if it has
+                   changed since previous index */
+                if(crawler->index) {
+                    if(crawl_index_add(dir->index_node, name,
+                        &worker->files[i].st) == NULL) {
+                        crawler->error = 1;
+                        break;
+                    }
+                    if(crawl_index_unchanged(crawl_index_child(dir->index_old,
+                        name), &worker->files[i].st))
+                        continue;
+                }
+                if((path = crawl_path(worker, dir, name)) == NULL) {
+                    crawler->error = 1;
+                    break;
+                }
+                crawl_handle_entry(crawler, path, worker->files[i].size);
+            }
+            pthread_mutex_unlock(&crawler->lock);
+        }
+
+        if(addme) {
+            addme = 0;
+            if((options->dirs_only == OPT_DIRSONLY) ||
+                ((options->leaf_dirs == OPT_LEAFDIRS) && (!dirsfound)) ||
+                ((options->dirs_include >= OPT_EMPTYDIRS) && empty))
+                addme = 1;
+            /* add all directories as empty ones with -zzz */
+            if((!addme) && (options->dirs_include >= OPT_ALLDIRS)) {
+                addme = 1;
+                empty = 1;
+            }
+        }
+
+        if(addme) {
+            /* check for name validity regarding include/exclude options */
+            if(!valid_filename(&dir->path[dir->name_offset], options, 1)) {
+                if(options->verbose >= OPT_VERBOSE)
+                    fprintf(stderr, "Skipping directory: '%s'\n", dir->path);
+            }
+            /* when using option -b, mountpoints are added with a null size */
+            else if(empty || (dir->flags & CRAWL_NODESCEND))
+                dir->entry = CRAWL_ENTRY_EMPTY;
+            else if(options->dirs_only == OPT_NODIRSONLY)
+                dir->entry = CRAWL_ENTRY_RECURSIVE;
+            else
+                dir->entry = CRAWL_ENTRY_FILES;
+        }
+    }
+
+    pthread_mutex_lock(&crawler->lock);
+    if(error)
+        crawler->error = 1;
+    /* never consider an incompletely-read directory as unchanged */
+    if(incomplete && (dir->index_node != NULL))
+        dir->index_node->record.flags |= CRAWL_INDEX_INCOMPLETE;
+    dir->files_size = files_size;
+    dir->size += files_size;
+    crawl_release_dir(crawler, dir);
+    pthread_mutex_unlock(&crawler->lock);
+}
+
+/* Worker thread main loop */
+static void *
+crawl_worker_main(void *arg)
+{
+    assert(arg != NULL);
+
+    struct crawl_worker *worker = arg;
+    struct crawler *crawler = worker->crawler;
+    struct crawl_dir *dir = NULL;
+
+    while(1) {
+        if((dir = crawl_pop_dir(worker)) == NULL) {
+            /* wait for more work or for crawling to end */
+            pthread_mutex_lock(&crawler->pool_lock);
+            while((!crawler->done) && (crawler->queued == 0))
+                pthread_cond_wait(&crawler->pool_cond, &crawler->pool_lock);
+            if(crawler->done) {
+                pthread_mutex_unlock(&crawler->pool_lock);
+                break;
+            }
+            pthread_mutex_unlock(&crawler->pool_lock);
+            continue;
+        }
+
+        crawl_directory(worker, dir);
+
+        pthread_mutex_lock(&crawler->pool_lock);
+        crawler->active--;
+        if((crawler->active == 0) && (crawler->queued == 0)) {
+            crawler->done = 1;
+            pthread_cond_broadcast(&crawler->pool_cond);
+        }
+        pthread_mutex_unlock(&crawler->pool_lock);
+    }
+
+    return (NULL);
+}
+
+/* Examine a root path: add it if it is a file, else prepare it for crawling
+   - root is set to the directory to crawl, or NULL if there is none
+   - returns 0 (success) or 1 (failure) */
+static int
+crawl_root(struct crawler *crawler, char *file_path, struct crawl_dir **root)
+{
+    assert(crawler != NULL);
+    assert(file_path != NULL);
+    assert(root != NULL);
+
+    struct program_options *options = crawler->options;
+    struct stat st;
+
+    *root = NULL;
+
+    /* examine root, symbolic links are followed with -l only */
+    if(((options->follow_symbolic_links == OPT_FOLLOWSYMLINKS) ?
+        stat(file_path, &st) : lstat(file_path, &st)) != 0) {
+        if((options->follow_symbolic_links != OPT_FOLLOWSYMLINKS) ||
+            (lstat(file_path, &st) != 0)) {
+            fprintf(stderr, "%s: %s\n", file_path, strerror(errno));
+            return (0);
+        }
+    }
+
+    /* file given as argument */
+    if(!S_ISDIR(st.st_mode)) {
+        char *file_name = strrchr(file_path, '/');
+        file_name = ((file_name != NULL) && (file_name[1] != '\0')) ?
+            file_name + 1 : file_path;
+
+        /* check for name validity regarding include/exclude options */
+        if(!valid_filename(file_name, options, 1)) {
+            if(options->verbose >= OPT_VERBOSE)
+                fprintf(stderr, "Skipping file: '%s'\n", file_path);
+            return (0);
+        }
+        /* with option -I, record file and add it only if it has changed */
+        if(crawler->index) {
+            if(crawl_index_add(NULL, file_path, &st) == NULL)
+                return (1);
+            if(crawl_index_unchanged(crawl_index_root(file_path), &st))
+                return (0);
+        }
+        /* workers are not started yet, no need to lock */
+        return (crawl_handle_entry(crawler, file_path, get_size(&st)));
+    }
+
+    if((*root = new_crawl_dir(NULL, file_path, &st)) == NULL)
+        return (1);
+
+    /* check for name validity regarding exclude options */
+    if(!valid_filename(&(*root)->path[(*root)->name_offset], options, 0)) {
+        if(options->verbose >= OPT_VERBOSE)
+            fprintf(stderr, "Skipping directory: '%s'\n", file_path);
+        free(*root);
+        *root = NULL;
+        return (0);
+    }
+    if((options->dir_depth != OPT_NODIRDEPTH) && (options->dir_depth == 0)) {
+        (*root)->flags |= CRAWL_SIZING;
+        (*root)->entry = CRAWL_ENTRY_DEPTH;
+    }
+    if(crawler->index) {
+        if(((*root)->index_node = crawl_index_add(NULL, file_path, &st)) ==
+            NULL) {
+            free(*root);
+            *root = NULL;
+            return (1);
+        }
+        (*root)->index_old = crawl_index_root(file_path);
+        if(crawl_index_unchanged((*root)->index_old, &st))
+            (*root)->flags |= CRAWL_UNCHANGED;
+    }
+
+    return (0);
+}
+
+/* Initialize a double-linked list of file_entries from several paths, using
+   several threads (option -t)
+   - same as init_file_entries() but entries are added in no specific order
+   - paths are crawled concurrently, workers share their directories
+   - also used to build an index (option -I) and add changed entries only */
+int
+parallel_init_file_entries(char **file_paths, unsigned int num_paths,
+    struct file_entry **head, fnum_t *count, struct program_options *options)
+{
+    assert(file_paths != NULL);
+    assert(head != NULL);
+    assert(count != NULL);
+    assert(options != NULL);
+    assert((options->num_threads > 1) || (options->index_filename != NULL));
+
+    struct crawler crawler;
+    struct crawl_dir *root = NULL;
+    unsigned int num_roots = 0;
+    unsigned int i;
+    unsigned int num_started = 0;
+
+    /* initialize crawler and workers */
+    crawler.options = options;
+    crawler.index = (options->index_filename != NULL);
+    crawler.head = head;
+    crawler.count = count;
+    crawler.error = 0;
+    crawler.queued = 0;
+    crawler.active = 0;
+    crawler.done = 0;
+    crawler.num_workers = options->num_threads;
+    if_not_malloc(crawler.workers,
+        sizeof(struct crawl_worker) * crawler.num_workers,
+        return (1);
+    )
+    pthread_mutex_init(&crawler.lock, NULL);
+    pthread_mutex_init(&crawler.pool_lock, NULL);
+    pthread_cond_init(&crawler.pool_cond, NULL);
+    for(i = 0 ; i < crawler.num_workers ; i++) {
+        struct crawl_worker *worker = &crawler.workers[i];
+        worker->crawler = &crawler;
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->queue = NULL;
+        worker->queue_first = 0;
+        worker->queue_last = 0;
+        worker->queue_size = 0;
+        worker->files = NULL;
+        worker->num_files = 0;
+        worker->files_size = 0;
+        worker->names = NULL;
+        worker->names_used = 0;
+        worker->names_size = 0;
+        worker->path = NULL;
+        worker->path_size = 0;
+    }
+
+    /* examine roots and spread them among workers' queues */
+    for(i = 0 ; i < num_paths ; i++) {
+        assert(file_paths[i] != NULL);
+        if(crawl_root(&crawler, file_paths[i], &root) != 0) {
+            crawler.error = 1;
+            break;
+        }
+        if(root != NULL) {
+            crawl_push_dir(&crawler.workers[num_roots % crawler.num_workers],
+                root);
+            num_roots++;
+        }
+    }
+
+    /* start crawling */
+    for(i = 0 ; (num_roots > 0) && (i < crawler.num_workers) ; i++) {
+        if(pthread_create(&crawler.workers[i].thread, NULL,
+            &crawl_worker_main, &crawler.workers[i]) != 0) {
+            fprintf(stderr, "%s(): cannot create thread\n", __func__);
+            break;
+        }
+        num_started++;
+    }
+    if((num_roots > 0) && (num_started == 0)) {
+        /* crawl from current thread */
+        crawl_worker_main(&crawler.workers[0]);
+    }
+    for(i = 0 ; i < num_started ; i++)
+        pthread_join(crawler.workers[i].thread, NULL);
+
+#if defined(DEBUG)
+    fprintf(stderr, "%s(): crawled %u path(s) using %u thread(s)\n",
+        __func__, num_paths, num_started);
+#endif
+
+    /* cleanup */
+    for(i = 0 ; i < crawler.num_workers ; i++) {
+        struct crawl_worker *worker = &crawler.workers[i];
+        assert(worker->queue_first == worker->queue_last);
+        free(worker->path);
+        free(worker->names);
+        free(worker->files);
+        free(worker->queue);
+        pthread_mutex_destroy(&worker->lock);
+    }
+    pthread_cond_destroy(&crawler.pool_cond);
+    pthread_mutex_destroy(&crawler.pool_lock);
+    pthread_mutex_destroy(&crawler.lock);
+    free(crawler.workers);
+
+    return (crawler.error);
+}
@@ -34,6 +34,12 @@
 /* fprintf(3) */
 #include <stdio.h>
 
+/* memset(3), memmove(3) */
+#include <string.h>
+
+/* gettimeofday(2) */
+#include <sys/time.h>
+
 /* assert(3) */
 #include <assert.h>
 
@@ -57,77 +63,482 @@ sort_file_entry_p(const void *a, const void *b)
         return (0);
 }
 
+/* Sort key of a file entry ; sizes are mapped to unsigned integers whose
+   ascending order is the descending order of sizes */
+struct file_entry_key {
+    unsigned long long key;
+    struct file_entry *fe;
+};
+
+#define RADIX_BITS      8
+#define RADIX_BUCKETS   (1 << RADIX_BITS)
+#define RADIX_PASSES    ((int)(sizeof(unsigned long long) * 8 / RADIX_BITS))
+
+/* Sort an array of file_entry pointers given file size, biggest to smallest,
+   using a (stable) LSD radix sort: entries of the same size keep their
+   order. Passes where every key share the same digit are skipped
+   - returns 0 (success) or 1 (failure, array left untouched) */
+int
+radix_sort_file_entry_p(struct file_entry **file_entry_p, fnum_t num_entries)
+{
+    assert(file_entry_p != NULL);
+
+    struct file_entry_key *keys = NULL;
+    struct file_entry_key *sorted = NULL;
+    fnum_t counts[RADIX_PASSES][RADIX_BUCKETS];
+    fnum_t i;
+    int pass;
+
+    if(num_entries <= 1)
+        return (0);
+
+    /* no message here, caller may fall back to qsort(3) */
+    if((keys = malloc(sizeof(struct file_entry_key) * num_entries)) == NULL)
+        return (1);
+    if((sorted = malloc(sizeof(struct file_entry_key) * num_entries)) ==
+        NULL) {
+        free(keys);
+        return (1);
+    }
+
+    /* build keys and count digits for every pass at once */
+    memset(counts, 0, sizeof(counts));
+    for(i = 0 ; i < num_entries ; i++) {
+        assert(file_entry_p[i] != NULL);
+        unsigned long long key =
+            ~((unsigned long long)file_entry_p[i]->size ^ (1ULL << 63));
+        keys[i].key = key;
+        keys[i].fe = file_entry_p[i];
+        for(pass = 0 ; pass < RADIX_PASSES ; pass++)
+            counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+    }
+
+    for(pass = 0 ; pass < RADIX_PASSES ; pass++) {
+        fnum_t *count = counts[pass];
+        fnum_t offset = 0;
+        int shift = pass * RADIX_BITS;
+        int bucket;
+
+        /* all keys share the same digit, nothing to do */
+        if(count[(keys[0].key >> shift) & (RADIX_BUCKETS - 1)] == num_entries)
+            continue;
+
+        for(bucket = 0 ; bucket < RADIX_BUCKETS ; bucket++) {
+            fnum_t bucket_count = count[bucket];
+            count[bucket] = offset;
+            offset += bucket_count;
+        }
+        for(i = 0 ; i < num_entries ; i++)
+            sorted[count[(keys[i].key >> shift) & (RADIX_BUCKETS - 1)]++] =
+                keys[i];
+
+        struct file_entry_key *swap = keys;
+        keys = sorted;
+        sorted = swap;
+    }
+
+    for(i = 0 ; i < num_entries ; i++)
+        file_entry_p[i] = keys[i].fe;
+
+    free(sorted);
+    free(keys);
+    return (0);
+}
+
 /* Dispatch file_entries by assigning them a partition number
    - a sorted array of file entry pointers must be provided as an argument
-   - as well as a pointer to a double linked-list of partitions' head
-     that will contain the total amount of data of each assigned file */
+   - as well as a table of partitions that will contain the total amount of
+     data of each assigned file
+   - each file is assigned to the partition with the lowest cost, a
+     partition's cost being its size plus file_cost bytes per file (sorting
+     by size also sorts by cost, biggest first) */
 int
 dispatch_file_entry_p_by_size(struct file_entry **file_entry_p,
-    fnum_t num_entries, struct partition *head, pnum_t num_parts)
+    fnum_t num_entries, struct partition_table *partitions,
+    fsize_t file_cost)
 {
-    assert(head != NULL);
-    assert(num_parts > 0);
+    assert(partitions != NULL);
+    assert(partitions->num_parts > 0);
+    assert(file_cost >= 0);
+
+    /* keep partitions ordered by cost to get the least-loaded one quickly */
+    struct partition_heap heap;
+    if(init_partition_heap(&heap, partitions, file_cost) != 0) {
+        fprintf(stderr, "%s(): cannot init partition heap\n", __func__);
+        return (1);
+    }
 
     fnum_t i = 0;
     while((file_entry_p != NULL) && (file_entry_p[i] != NULL) &&
         (i < num_entries)) {
         /* find most approriate partition */
-        pnum_t smallest_partition_index = find_smallest_partition_index(head);
-        struct partition *smallest_partition =
-            get_partition_at(head, smallest_partition_index);
-        if(smallest_partition == NULL) {
-            fprintf(stderr, "%s(): get_partition_at() returned NULL\n",
-                __func__);
-            return (1);
-        }
+        pnum_t smallest_partition_index = partition_heap_min_index(&heap);
+        struct partition *smallest_partition = partition_heap_min(&heap);
+
         /* assign it */
         file_entry_p[i]->partition_index = smallest_partition_index;
 #if defined(DEBUG)
         fprintf(stderr, "%s(): %s added to partition %d (%p)\n", __func__,
-            file_entry_p[i]->path, file_entry_p[i]->partition_index,
-            smallest_partition);
+            file_entry_path(file_entry_p[i]),
+            file_entry_p[i]->partition_index, smallest_partition);
 #endif
         /* and load the partition with file size */
         smallest_partition->size += file_entry_p[i]->size;
         smallest_partition->num_files++;
+        partition_heap_update_min(&heap);
         i++;
     }
+
+    uninit_partition_heap(&heap);
     return (0);
 }
 
+/* Files of a partition, sorted by size (biggest first),
+   used when refining partitions */
+struct refine_part {
+    struct file_entry **files;
+    fnum_t num_files;
+    fnum_t alloc_files;
+};
+
+/* A candidate move or swap of files between the most-loaded partition and
+   another one */
+struct refine_action {
+    int found;                      /* an action has been found */
+    int swap;                       /* swap files instead of moving one */
+    fnum_t from_index;              /* file leaving the most-loaded part */
+    fnum_t to_index;                /* file leaving the other part (swap) */
+    fsize_t gap;                    /* distance to a perfect balance of
+                                       both parts (twice the cost moved
+                                       minus their difference) */
+};
+
+/* Return the current time, in milliseconds */
+static long long
+refine_clock(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (((long long)tv.tv_sec * 1000) + (tv.tv_usec / 1000));
+}
+
+/* Return the index of the first file of part whose size is lower than or
+   equal to size */
+static fnum_t
+refine_part_lower_bound(struct refine_part *part, fsize_t size)
+{
+    assert(part != NULL);
+
+    fnum_t lo = 0;
+    fnum_t hi = part->num_files;
+
+    while(lo < hi) {
+        fnum_t mid = lo + ((hi - lo) / 2);
+        if(part->files[mid]->size > size)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo);
+}
+
+/* Move file at index i of part to its place after it has been put there by
+   a swap or a move (files must remain sorted by size, biggest first) */
+static void
+refine_part_reposition(struct refine_part *part, fnum_t i)
+{
+    assert(part != NULL);
+    assert(i < part->num_files);
+
+    struct file_entry *fe = part->files[i];
+
+    while((i > 0) && (part->files[i - 1]->size < fe->size)) {
+        part->files[i] = part->files[i - 1];
+        i--;
+    }
+    while(((i + 1) < part->num_files) &&
+        (part->files[i + 1]->size > fe->size)) {
+        part->files[i] = part->files[i + 1];
+        i++;
+    }
+    part->files[i] = fe;
+}
+
+/* Consider moving a cost of delta from a part to another one whose costs
+   differ by diff ; keep it in action if it beats the current one */
+static void
+refine_consider(struct refine_action *action, fsize_t delta, fsize_t diff,
+    int swap, fnum_t from_index, fnum_t to_index)
+{
+    assert(action != NULL);
+
+    /* only strictly lower the most-loaded part without overloading
+       the other one */
+    if((delta <= 0) || (delta >= diff))
+        return;
+
+    fsize_t gap = (2 * delta) - diff;
+    if(gap < 0)
+        gap = -gap;
+    if((!action->found) || (gap < action->gap)) {
+        action->found = 1;
+        action->swap = swap;
+        action->from_index = from_index;
+        action->to_index = to_index;
+        action->gap = gap;
+    }
+}
+
+/* Find the best move or swap of files between parts from and to,
+   whose costs differ by diff
+   - returns 1 if an action lowering the cost of from has been found */
+static int
+refine_find_action(struct refine_part *from, struct refine_part *to,
+    fsize_t diff, fsize_t file_cost, struct refine_action *action)
+{
+    assert(from != NULL);
+    assert(to != NULL);
+    assert(diff > 0);
+    assert(action != NULL);
+
+    fsize_t half = diff / 2;
+    fnum_t i, j;
+
+    action->found = 0;
+    action->swap = 0;
+    action->from_index = 0;
+    action->to_index = 0;
+    action->gap = 0;
+
+    /* move a file whose cost is close to half of the difference */
+    j = refine_part_lower_bound(from, half - file_cost);
+    if(j < from->num_files)
+        refine_consider(action, from->files[j]->size + file_cost, diff,
+            0, j, 0);
+    if(j > 0)
+        refine_consider(action, from->files[j - 1]->size + file_cost, diff,
+            0, j - 1, 0);
+
+    /* swap two files whose sizes differ by about half of the difference
+       (their costs differ by as much) */
+    for(i = 0 ; (i < from->num_files) && (to->num_files > 0) ; i++) {
+        fsize_t size = from->files[i]->size;
+
+        /* files are sorted, smaller ones cannot help */
+        if(size <= to->files[to->num_files - 1]->size)
+            break;
+        /* both parts cannot get any closer */
+        if(action->found && (action->gap <= 1))
+            break;
+
+        j = refine_part_lower_bound(to, size - half);
+        if(j < to->num_files)
+            refine_consider(action, size - to->files[j]->size, diff,
+                1, i, j);
+        if(j > 0)
+            refine_consider(action, size - to->files[j - 1]->size, diff,
+                1, i, j - 1);
+    }
+
+    return (action->found);
+}
+
+/* Apply action between parts from_index and to_index, updating partitions
+   - returns 0 (success) or 1 (failure, nothing changed) */
+static int
+refine_apply_action(struct refine_part *parts,
+    struct partition_table *partitions, pnum_t from_index, pnum_t to_index,
+    struct refine_action *action)
+{
+    assert(parts != NULL);
+    assert(partitions != NULL);
+    assert(action != NULL);
+    assert(action->found);
+
+    struct refine_part *from = &parts[from_index];
+    struct refine_part *to = &parts[to_index];
+    struct partition *from_partition = &partitions->parts[from_index];
+    struct partition *to_partition = &partitions->parts[to_index];
+    struct file_entry *fe = from->files[action->from_index];
+
+    if(action->swap) {
+        /* swap files, then restore order */
+        struct file_entry *other = to->files[action->to_index];
+
+        from_partition->size += other->size - fe->size;
+        to_partition->size += fe->size - other->size;
+        fe->partition_index = to_index;
+        other->partition_index = from_index;
+
+        from->files[action->from_index] = other;
+        to->files[action->to_index] = fe;
+        refine_part_reposition(from, action->from_index);
+        refine_part_reposition(to, action->to_index);
+    }
+    else {
+        /* move file */
+        if(to->num_files == to->alloc_files) {
+            fnum_t alloc_files = (to->alloc_files * 2) + 1;
+            if_not_realloc(to->files,
+                sizeof(struct file_entry *) * alloc_files,
+                return (1);
+            )
+            to->alloc_files = alloc_files;
+        }
+
+        from_partition->size -= fe->size;
+        from_partition->num_files--;
+        to_partition->size += fe->size;
+        to_partition->num_files++;
+        fe->partition_index = to_index;
+
+        memmove(&from->files[action->from_index],
+            &from->files[action->from_index + 1],
+            sizeof(struct file_entry *) *
+            (from->num_files - action->from_index - 1));
+        from->num_files--;
+        to->files[to->num_files] = fe;
+        to->num_files++;
+        refine_part_reposition(to, to->num_files - 1);
+    }
+    return (0);
+}
+
+/* Refine an assignment of files to partitions produced by
+   dispatch_file_entry_p_by_size() using a local search: the most-loaded
+   partition repeatedly gives a file to, or swaps two files with, the
+   least-loaded partition that lets it get lighter, picking the move or swap
+   that best balances both partitions. Stops when no such move or swap exists
+   or after refine_time milliseconds.
+   - the (sorted) array of file entry pointers and table of partitions used
+     for dispatching must be provided as arguments
+   - files without cost (empty files when file_cost is 0) are left untouched
+   - returns 0 (success) or 1 (failure, partitions remain consistent) */
+int
+refine_file_entry_p(struct file_entry **file_entry_p, fnum_t num_entries,
+    struct partition_table *partitions, fsize_t file_cost,
+    unsigned int refine_time)
+{
+    assert(file_entry_p != NULL);
+    assert(partitions != NULL);
+    assert(partitions->num_parts > 0);
+    assert(file_cost >= 0);
+
+    long long deadline = refine_clock() + refine_time;
+    pnum_t num_parts = partitions->num_parts;
+    struct refine_part *parts = NULL;
+    pnum_t *order = NULL;
+    int error = 0;
+    fnum_t i;
+    pnum_t p;
+
+    if(num_parts < 2)
+        return (0);
+
+    if_not_malloc(parts, sizeof(struct refine_part) * num_parts,
+        return (1);
+    )
+    memset(parts, 0, sizeof(struct refine_part) * num_parts);
+
+    /* partitions, by cost (lightest first) */
+    if_not_malloc(order, sizeof(pnum_t) * num_parts,
+        free(parts);
+        return (1);
+    )
+
+    /* build each partition's list of files, keeping them sorted */
+    for(i = 0 ; i < num_entries ; i++) {
+        if(file_entry_p[i]->size + file_cost > 0)
+            parts[file_entry_p[i]->partition_index].alloc_files++;
+    }
+    for(p = 0 ; p < num_parts ; p++) {
+        order[p] = p;
+        if(parts[p].alloc_files == 0)
+            parts[p].alloc_files = 1;
+        if_not_malloc(parts[p].files,
+            sizeof(struct file_entry *) * parts[p].alloc_files,
+            error = 1;
+            break;
+        )
+    }
+    for(i = 0 ; (error == 0) && (i < num_entries) ; i++) {
+        if(file_entry_p[i]->size + file_cost > 0) {
+            struct refine_part *part =
+                &parts[file_entry_p[i]->partition_index];
+            part->files[part->num_files++] = file_entry_p[i];
+        }
+    }
+
+    while((error == 0) && (refine_clock() < deadline)) {
+        /* sort partitions by cost ; only two of them change at each step
+           so insertion sort is cheap */
+        for(p = 1 ; p < num_parts ; p++) {
+            pnum_t index = order[p];
+            fsize_t cost = partition_cost(&partitions->parts[index],
+                file_cost);
+            pnum_t q = p;
+            while((q > 0) && (partition_cost(&partitions->parts[order[q - 1]],
+                file_cost) > cost)) {
+                order[q] = order[q - 1];
+                q--;
+            }
+            order[q] = index;
+        }
+
+        pnum_t max_index = order[num_parts - 1];
+        fsize_t max_cost = partition_cost(&partitions->parts[max_index],
+            file_cost);
+        struct refine_action action;
+
+        /* find the lightest partition the most-loaded one can exchange
+           with */
+        for(p = 0 ; p < (num_parts - 1) ; p++) {
+            fsize_t diff = max_cost -
+                partition_cost(&partitions->parts[order[p]], file_cost);
+            if((diff > 0) && refine_find_action(&parts[max_index],
+                &parts[order[p]], diff, file_cost, &action))
+                break;
+        }
+        /* local optimum reached */
+        if(p == (num_parts - 1))
+            break;
+
+#if defined(DEBUG)
+        fprintf(stderr, "%s(): %s partitions %d and %d\n", __func__,
+            action.swap ? "swapping files between" :
+            "moving file between", max_index, order[p]);
+#endif
+        if(refine_apply_action(parts, partitions, max_index, order[p],
+            &action) != 0)
+            error = 1;
+    }
+
+    /* cleanup */
+    for(p = 0 ; p < num_parts ; p++) {
+        if(parts[p].files != NULL)
+            free(parts[p].files);
+    }
+    free(order);
+    free(parts);
+    return (error);
+}
+
 /* Dispatch empty file_entries (files with zero-byte size) from head by
    assigning them a more appropriate partition number.
    The idea is to get empty files spread accross partitions and not get them
    all in the last one.
-   - a double-linked list of partitions is provided as an argument */
+   - a table of partitions is provided as an argument */
 int
 dispatch_empty_file_entries(struct file_entry *head, fnum_t num_entries,
-    struct partition *part_head, pnum_t num_parts)
+    struct partition_table *partitions)
 {
     assert(head != NULL);
-    assert(part_head != NULL);
-    assert(num_parts > 0);
-
-    /* backup head */
-    struct file_entry *start = head;
-
-    /* first pass: count empty files */
-    fnum_t num_empty_entries = 0;
-    while(head != NULL) {
-        if(head->size == 0)
-            num_empty_entries++;
-        head = head->nextp;
-    }
-    /* go back to original head */
-    head = start;
+    assert(partitions != NULL);
+    assert(partitions->num_parts > 0);
 
     /* compute mean file entry number per partition */
-    fnum_t mean_files = (num_entries / num_parts);
-
-    /* be sure to start at first partition as we are handling indexes here.
-       Starting at first file_entry is not necessary as we would not corrupt
-       any information, but just skip a few file entries */
-    rewind_list(part_head);
+    fnum_t mean_files = (num_entries / partitions->num_parts);
 
     /* for each empty file, associate it with the first partition
        having less files than mean_files */
@@ -135,151 +546,179 @@ dispatch_empty_file_entries(struct file_entry *head, fnum_t num_entries,
         if(head->size == 0) {
             /* empty file found */
             pnum_t j = 0;
-            /* backup partition head */
-            struct partition *part_start = part_head;
-
-            while(part_head != NULL) {
+            while(j < partitions->num_parts) {
+                struct partition *part = &partitions->parts[j];
                 if((head->partition_index != j) &&
-                   (part_head->num_files < mean_files)) {
-                    struct partition *previous_partition =
-                        get_partition_at(part_start, head->partition_index);
-                    if(previous_partition == NULL) {
-                        fprintf(stderr, "%s(): "
-                            "get_partition_at() returned NULL\n", __func__);
-                        return (1);
-                    }
+                   (part->num_files < mean_files)) {
                     /* unload the previous part (only affects the number
                        of files, size does not change) */
-                    previous_partition->num_files--;
+                    get_partition_at(partitions,
+                        head->partition_index)->num_files--;
                     /* load the new part */
-                    part_head->num_files++;
+                    part->num_files++;
                     /* assign new index to file entry */
                     head->partition_index = j;
 #if defined(DEBUG)
                     fprintf(stderr, "%s(): %s (empty) re-assigned to partition "
-                        "%d (%p)\n", __func__, head->path,
-                        head->partition_index, part_head);
+                        "%d (%p)\n", __func__, file_entry_path(head),
+                        head->partition_index, part);
 #endif
                     break;
                 }
-                part_head = part_head->nextp;
                 j++;
             }
-            /* go back to original head */
-            part_head = part_start;
         }
         head = head->nextp;
     }
     return (0);
 }
 
+/* Return how big a file partition can still accept, given max_entries
+   (maximum files per partitions) and max_size (max partition size) */
+static fsize_t
+partition_room(struct partition *partition, fnum_t max_entries,
+    fsize_t max_size)
+{
+    assert(partition != NULL);
+
+    if((max_entries > 0) && ((partition->num_files + 1) > max_entries))
+        return (PARTITION_NO_ROOM);
+    if(max_size > 0)
+        return (max_size - partition->size);
+    return (PARTITION_ANY_ROOM);
+}
+
 /* Dispatch file_entries from head into partitions that will be created
    on-the-fly, with respect to max_entries (maximum files per partitions)
    and max_size (max partition size)
-   - must be called with *part_head == NULL (will create partitions)
+   - if file_entry_p is not NULL, its num_entries files are dispatched in that
+     order instead (e.g. sorted by size, biggest first, to get a first-fit
+     decreasing packing)
+   - must be called with an empty table of partitions (will create partitions)
    - if max_size > 0, partition 0 will hold files that cannot be held by other
      partitions
-   - returns the number of parts created with part_head set to the last
-     element */
+   - each file goes to the first partition it fits in ; partitions are indexed
+     by room left so that partition is found in O(log(partitions))
+   - returns the number of parts created, or 0 on failure */
 pnum_t
 dispatch_file_entries_by_limits(struct file_entry *head,
-    struct partition **part_head, fnum_t max_entries, fsize_t max_size,
+    struct file_entry **file_entry_p, fnum_t num_entries,
+    struct partition_table *partitions, fnum_t max_entries, fsize_t max_size,
     struct program_options *options)
 {
     assert(head != NULL);
-    assert((part_head != NULL) && (*part_head == NULL));
+    assert((file_entry_p == NULL) || (num_entries > 0));
+    assert((partitions != NULL) && (partitions->num_parts == 0));
     assert(max_size >= 0);
     assert(options != NULL);
 
-    /* number of partitions created, our return value */
-    pnum_t num_parts_created = 0;
-
     /* when max_size is used, create a default partition (partition 0) 
        that will hold files that does not match criteria */
     if(max_size > 0) {
-        if(add_partitions(part_head, 1, options) != 0) {
+        if(add_partitions(partitions, 1, options) != 0) {
             fprintf(stderr, "%s(): cannot init default partition\n", __func__);
-            return (num_parts_created);
+            return (0);
         }
-        num_parts_created++;
     }
-    struct partition *default_partition = *part_head;
     pnum_t default_partition_index = 0;
 
-    /* create a first data partition and keep a pointer to it */
-    if(add_partitions(part_head, 1, options) != 0) {
+    /* index of data partitions by room left (the default partition is not
+       indexed, so it has no room) */
+    struct partition_fit_tree tree;
+    init_partition_fit_tree(&tree);
+
+    /* create a first data partition */
+    if(add_partitions(partitions, 1, options) != 0) {
         fprintf(stderr, "%s(): cannot create partition\n", __func__);
-        return (num_parts_created);
+        uninit_partition_fit_tree(&tree);
+        return (0);
     }
-    num_parts_created++;
-    struct partition *start_partition = *part_head;
-    pnum_t start_partition_index = num_parts_created - 1;
+    pnum_t start_partition_index = partitions->num_parts - 1;
 
-    /* for each file, associate it with current partition
-       (or default_partition) */
-    pnum_t current_partition_index = start_partition_index;
-    while(head != NULL) {
-        /* max_size provided and file size > max_size,
+    /* room of a new (empty) partition */
+    fsize_t new_partition_room =
+        partition_room(get_partition_at(partitions, start_partition_index),
+        max_entries, max_size);
+
+    if(partition_fit_tree_set(&tree, start_partition_index,
+        new_partition_room) != 0) {
+        fprintf(stderr, "%s(): cannot index partition\n", __func__);
+        uninit_partition_fit_tree(&tree);
+        return (0);
+    }
+
+    /* for each file, associate it with the first partition it fits in
+       (or default partition) */
+    fnum_t i = 0;
+    struct file_entry *current = (file_entry_p != NULL) ?
+        file_entry_p[0] : head;
+    while(current != NULL) {
+        /* find the first partition the file fits in */
+        pnum_t current_partition_index =
+            partition_fit_tree_first(&tree, current->size);
+
+        /* max_size provided and file size > max_size, or file fits in no
+           partition, not even a new one (because of preloading),
            associate file to default partition */
-        if((max_size > 0) && (head->size > max_size)) {
-            head->partition_index = default_partition_index;
-            default_partition->size += head->size;
+        if((max_size > 0) && ((current->size > max_size) ||
+            ((current_partition_index >= partitions->num_parts) &&
+            (current->size > new_partition_room)))) {
+            struct partition *default_partition =
+                get_partition_at(partitions, default_partition_index);
+            current->partition_index = default_partition_index;
+            default_partition->size += current->size;
             default_partition->num_files++;
 #if defined(DEBUG)
             fprintf(stderr, "%s(): %s added to partition %d (%p)\n",
-                __func__, head->path, head->partition_index, default_partition);
+                __func__, file_entry_path(current), current->partition_index,
+                default_partition);
 #endif
         }
         else {
-            /* examine each partition */
-            while((*part_head) != NULL) {
-                /* if file does not fit in partition */
-                if(((max_entries > 0) && (((*part_head)->num_files + 1) > max_entries)) ||
-                    ((max_size > 0) && (((*part_head)->size + head->size) > max_size))) {
-                    /* and we reached last partition, chain a new one */
-                    if((*part_head)->nextp == NULL) {
-                        if(add_partitions(part_head, 1, options) != 0) {
-                            fprintf(stderr, "%s(): cannot create partition\n",
-                                __func__);
-                            return (num_parts_created);
-                        }
-                        num_parts_created++;
+            /* no partition found, chain a new one */
+            if(current_partition_index >= partitions->num_parts) {
+                if(add_partitions(partitions, 1, options) != 0) {
+                    fprintf(stderr, "%s(): cannot create partition\n",
+                        __func__);
+                    uninit_partition_fit_tree(&tree);
+                    return (0);
+                }
 #if defined(DEBUG)
-                        fprintf(stderr, "%s(): chained one partition (%p)\n",
-                            __func__, *part_head);
+                fprintf(stderr, "%s(): added partition %d\n",
+                    __func__, partitions->num_parts - 1);
 #endif
-                    }
-                    else {
-                        /* examine next partition */
-                        *part_head = (*part_head)->nextp;
-                    }
-                    current_partition_index++;
-                }
-                else {
-                    /* file fits in current partition, add it */
-                    head->partition_index = current_partition_index;
-                    (*part_head)->size += head->size;
-                    (*part_head)->num_files++;
+                current_partition_index = partitions->num_parts - 1;
+            }
+
+            /* add file to partition */
+            struct partition *current_partition =
+                get_partition_at(partitions, current_partition_index);
+            current->partition_index = current_partition_index;
+            current_partition->size += current->size;
+            current_partition->num_files++;
 #if defined(DEBUG)
-                    fprintf(stderr, "%s(): %s added to partition %d (%p)\n",
-                        __func__, head->path, head->partition_index,
-                        *part_head);
+            fprintf(stderr, "%s(): %s added to partition %d (%p)\n",
+                __func__, file_entry_path(current), current->partition_index,
+                current_partition);
 #endif
 
-                    /* examine next file */
-                    break;
-                }
+            /* and update its room */
+            if(partition_fit_tree_set(&tree, current_partition_index,
+                partition_room(current_partition, max_entries, max_size))
+                != 0) {
+                fprintf(stderr, "%s(): cannot index partition\n", __func__);
+                uninit_partition_fit_tree(&tree);
+                return (0);
             }
-
-            assert(*part_head != NULL);
         }
 
         /* examine next file */
-        head = head->nextp;
-
-        /* come back to the first partition */
-        current_partition_index = start_partition_index;
-        *part_head = start_partition;
+        if(file_entry_p != NULL)
+            current = ((++i) < num_entries) ? file_entry_p[i] : NULL;
+        else
+            current = current->nextp;
     }
-    return (num_parts_created);
+
+    uninit_partition_fit_tree(&tree);
+    return (partitions->num_parts);
 }
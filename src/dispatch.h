@@ -33,12 +33,19 @@
 #include "options.h"
 
 int sort_file_entry_p(const void *a, const void *b);
+int radix_sort_file_entry_p(struct file_entry **file_entry_p,
+    fnum_t num_entries);
 int dispatch_file_entry_p_by_size(struct file_entry **file_entry_p,
-    fnum_t num_entries, struct partition *head, pnum_t num_parts);
+    fnum_t num_entries, struct partition_table *partitions,
+    fsize_t file_cost);
+int refine_file_entry_p(struct file_entry **file_entry_p, fnum_t num_entries,
+    struct partition_table *partitions, fsize_t file_cost,
+    unsigned int refine_time);
 int dispatch_empty_file_entries(struct file_entry *head, fnum_t num_entries,
-    struct partition *part_head, pnum_t num_parts);
+    struct partition_table *partitions);
 pnum_t dispatch_file_entries_by_limits(struct file_entry *head,
-    struct partition **part_head, fnum_t max_entries, fsize_t max_size,
+    struct file_entry **file_entry_p, fnum_t num_entries,
+    struct partition_table *partitions, fnum_t max_entries, fsize_t max_size,
     struct program_options *options);
 
 #endif /* _DISPATCH_H */
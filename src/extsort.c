@@ -0,0 +1,759 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "options.h"
+#include "partition.h"
+#include "file_entry.h"
+#include "dispatch.h"
+#include "output.h"
+#include "file_list.h"
+#include "extsort.h"
+
+/* fprintf(3), snprintf(3) */
+#include <stdio.h>
+
+/* malloc(3), qsort(3), getenv(3), mkstemp(3) */
+#include <stdlib.h>
+
+/* strerror(3), strlen(3), memcpy(3) */
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* uint32_t */
+#include <stdint.h>
+
+/* read(2), close(2), lseek(2), unlink(2) */
+#include <sys/types.h>
+#include <unistd.h>
+
+/* _PATH_TMP */
+#if defined(__sun) || defined(__sun__)
+#define _PATH_TMP       "/tmp/"
+#else
+#include <paths.h>
+#endif
+
+/* assert(3) */
+#include <assert.h>
+
+/**************************************
+ External sort functions (option -M)
+ **************************************/
+
+/* When memory limit is reached, in-memory file entries are sorted and
+   written to a temporary file (a run), then released. Runs are finally
+   merged and the resulting stream is dispatched and written to partitions.
+
+   A run is a sequence of records (see file_list.h), sorted from biggest to
+   smallest size:
+     fsize_t size | uint32_t path length | path (without ending '\0')
+   Runs are kept in the order they have been produced and merged
+   group-wise, ties being resolved by run order: the merge produces entries
+   in the same order as an in-memory stable sort */
+
+/* A run (temporary file, unlinked as soon as created) */
+struct ext_run {
+    int fd;
+    fnum_t num_records;
+    unsigned int level;             /* number of merges it comes from */
+};
+
+/* A run reader */
+struct ext_reader {
+    struct ext_run *run;
+    char *data;                     /* read buffer */
+    size_t data_len;                /* buffered bytes */
+    size_t data_pos;                /* current position within buffer */
+    fnum_t remaining;               /* records left to read */
+
+    fsize_t size;                   /* current record */
+    char *path;
+    size_t path_len;
+    size_t path_size;               /* allocated bytes */
+};
+
+/* Records consumer */
+typedef int (*ext_emit_t)(void *ctx, fsize_t size, const char *path,
+    size_t path_len);
+
+/* Status */
+static struct {
+    struct ext_run *runs;           /* runs, in production order */
+    unsigned int num_runs;
+    unsigned int alloc_runs;
+    fnum_t num_entries;             /* in-memory entries */
+    struct ext_run listing;         /* lines to print to stdout once
+                                       partitions have been displayed */
+} ext_sort = {
+    NULL,
+    0,
+    0,
+    0,
+    { -1, 0, 0 }
+};
+
+/* Create an (unlinked) temporary file
+   - returns a file descriptor or -1 if error */
+static int
+ext_sort_tmpfile(const struct program_options *options)
+{
+    assert(options != NULL);
+
+    const char *tmp_dir = options->tmp_dir;
+    char *filename = NULL;
+    int fd = -1;
+
+    if(tmp_dir == NULL)
+        tmp_dir = getenv("TMPDIR");
+    if((tmp_dir == NULL) || (tmp_dir[0] == '\0'))
+        tmp_dir = _PATH_TMP;
+
+    size_t malloc_size = strlen(tmp_dir) + 1 + strlen(EXTSORT_TMPFILE) + 1;
+    if_not_malloc(filename, malloc_size,
+        return (-1);
+    )
+    snprintf(filename, malloc_size, "%s/%s", tmp_dir, EXTSORT_TMPFILE);
+
+    if((fd = mkstemp(filename)) < 0)
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    else
+        unlink(filename);
+
+    free(filename);
+    return (fd);
+}
+
+/* Append a run to the list of runs
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_sort_push_run(struct ext_run *run)
+{
+    assert(run != NULL);
+
+    if(ext_sort.num_runs >= ext_sort.alloc_runs) {
+        unsigned int alloc_runs = (ext_sort.alloc_runs > 0) ?
+            ext_sort.alloc_runs * 2 : EXTSORT_MAX_RUNS;
+        struct ext_run *runs = ext_sort.runs;
+        if_not_realloc(runs, sizeof(struct ext_run) * alloc_runs,
+            return (1);
+        )
+        ext_sort.runs = runs;
+        ext_sort.alloc_runs = alloc_runs;
+    }
+    ext_sort.runs[ext_sort.num_runs++] = *run;
+    return (0);
+}
+
+/* Read bytes from a run
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_reader_read(struct ext_reader *reader, void *dst, size_t len)
+{
+    assert(reader != NULL);
+    assert((dst != NULL) || (len == 0));
+
+    char *dstp = dst;
+
+    while(len > 0) {
+        if(reader->data_pos >= reader->data_len) {
+            ssize_t bytes = read(reader->run->fd, reader->data,
+                EXTSORT_BUFFER_SIZE);
+            if(bytes < 0) {
+                if(errno == EINTR)
+                    continue;
+                fprintf(stderr, "%s(): %s\n", __func__, strerror(errno));
+                return (1);
+            }
+            if(bytes == 0) {
+                fprintf(stderr, "%s(): unexpected end of temporary file\n",
+                    __func__);
+                return (1);
+            }
+            reader->data_len = bytes;
+            reader->data_pos = 0;
+        }
+
+        size_t chunk = min(len, reader->data_len - reader->data_pos);
+        memcpy(dstp, &reader->data[reader->data_pos], chunk);
+        reader->data_pos += chunk;
+        dstp += chunk;
+        len -= chunk;
+    }
+    return (0);
+}
+
+/* Read next record from a run
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_reader_next(struct ext_reader *reader)
+{
+    assert(reader != NULL);
+    assert(reader->remaining > 0);
+
+    uint32_t len = 0;
+
+    if((ext_reader_read(reader, &reader->size, sizeof(reader->size)) != 0) ||
+        (ext_reader_read(reader, &len, sizeof(len)) != 0))
+        return (1);
+
+    if((size_t)len + 1 > reader->path_size) {
+        size_t path_size = max((size_t)len + 1, reader->path_size * 2);
+        if_not_realloc(reader->path, path_size,
+            reader->path_size = 0;
+            return (1);
+        )
+        reader->path_size = path_size;
+    }
+    if(ext_reader_read(reader, reader->path, len) != 0)
+        return (1);
+    reader->path[len] = '\0';
+    reader->path_len = len;
+    reader->remaining--;
+    return (0);
+}
+
+/* Check if reader a's current record comes before reader b's one:
+   biggest size first, then run order */
+static int
+ext_reader_lower(const struct ext_reader *readers, unsigned int a,
+    unsigned int b)
+{
+    assert(readers != NULL);
+
+    if(readers[a].size != readers[b].size)
+        return (readers[a].size > readers[b].size);
+    return (a < b);
+}
+
+/* Restore heap property from a given position down */
+static void
+ext_heap_sift_down(const struct ext_reader *readers, unsigned int *heap,
+    unsigned int num, unsigned int pos)
+{
+    assert(readers != NULL);
+    assert(heap != NULL);
+
+    while(1) {
+        unsigned int child = (2 * pos) + 1;
+        if(child >= num)
+            break;
+        if((child + 1 < num) &&
+            ext_reader_lower(readers, heap[child + 1], heap[child]))
+            child++;
+        if(!ext_reader_lower(readers, heap[child], heap[pos]))
+            break;
+        unsigned int swap = heap[pos];
+        heap[pos] = heap[child];
+        heap[child] = swap;
+        pos = child;
+    }
+}
+
+/* Merge runs and feed records, in order, to an emit() function
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_sort_merge(struct ext_run *runs, unsigned int num_runs, ext_emit_t emit,
+    void *ctx)
+{
+    assert(runs != NULL);
+    assert(num_runs > 0);
+    assert(emit != NULL);
+
+    struct ext_reader *readers = NULL;
+    unsigned int *heap = NULL;
+    unsigned int num_heap = 0;
+    unsigned int i;
+    int error = 0;
+
+    if_not_malloc(readers, sizeof(struct ext_reader) * num_runs,
+        return (1);
+    )
+    if_not_malloc(heap, sizeof(unsigned int) * num_runs,
+        free(readers);
+        return (1);
+    )
+
+    for(i = 0 ; i < num_runs ; i++) {
+        readers[i].run = &runs[i];
+        readers[i].data = NULL;
+        readers[i].data_len = 0;
+        readers[i].data_pos = 0;
+        readers[i].remaining = runs[i].num_records;
+        readers[i].path = NULL;
+        readers[i].path_len = 0;
+        readers[i].path_size = 0;
+    }
+
+    /* rewind runs and read their first record */
+    for(i = 0 ; (i < num_runs) && (!error) ; i++) {
+        if(readers[i].remaining == 0)
+            continue;
+        if(lseek(runs[i].fd, 0, SEEK_SET) < 0) {
+            fprintf(stderr, "%s(): %s\n", __func__, strerror(errno));
+            error = 1;
+            break;
+        }
+        if_not_malloc(readers[i].data, EXTSORT_BUFFER_SIZE,
+            error = 1;
+            break;
+        )
+        if(ext_reader_next(&readers[i]) != 0) {
+            error = 1;
+            break;
+        }
+        heap[num_heap++] = i;
+    }
+    if(!error) {
+        for(i = num_heap / 2 ; i > 0 ; i--)
+            ext_heap_sift_down(readers, heap, num_heap, i - 1);
+    }
+
+    /* merge */
+    while((!error) && (num_heap > 0)) {
+        struct ext_reader *reader = &readers[heap[0]];
+
+        if(emit(ctx, reader->size, reader->path, reader->path_len) != 0) {
+            error = 1;
+            break;
+        }
+        if(reader->remaining > 0) {
+            if(ext_reader_next(reader) != 0) {
+                error = 1;
+                break;
+            }
+        }
+        else
+            heap[0] = heap[--num_heap];
+        ext_heap_sift_down(readers, heap, num_heap, 0);
+    }
+
+    for(i = 0 ; i < num_runs ; i++) {
+        if(readers[i].path != NULL)
+            free(readers[i].path);
+        if(readers[i].data != NULL)
+            free(readers[i].data);
+    }
+    free(heap);
+    free(readers);
+    return (error);
+}
+
+/* Records consumer writing to a run */
+static int
+ext_emit_run(void *ctx, fsize_t size, const char *path, size_t path_len)
+{
+    assert(ctx != NULL);
+
+    return (file_list_write_record(ctx, size, path, path_len));
+}
+
+/* Merge the last EXTSORT_MAX_RUNS runs into a single one as long as they
+   come from the same number of merges, to limit the number of runs (and
+   open files) while keeping runs in production order
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_sort_compact(struct program_options *options)
+{
+    assert(options != NULL);
+
+    while(ext_sort.num_runs >= EXTSORT_MAX_RUNS) {
+        struct ext_run *first =
+            &ext_sort.runs[ext_sort.num_runs - EXTSORT_MAX_RUNS];
+        struct ext_run merged;
+        struct out_buffer buffer;
+        unsigned int i;
+
+        for(i = 1 ; i < EXTSORT_MAX_RUNS ; i++) {
+            if(first[i].level != first[0].level)
+                return (0);
+        }
+
+        if((merged.fd = ext_sort_tmpfile(options)) < 0)
+            return (1);
+        merged.num_records = 0;
+        merged.level = first[0].level + 1;
+        for(i = 0 ; i < EXTSORT_MAX_RUNS ; i++)
+            merged.num_records += first[i].num_records;
+
+        init_out_buffer(&buffer, merged.fd, EXTSORT_BUFFER_SIZE);
+        if((ext_sort_merge(first, EXTSORT_MAX_RUNS, &ext_emit_run,
+            &buffer) != 0) ||
+            (out_buffer_flush(&buffer) != 0)) {
+            uninit_out_buffer(&buffer);
+            close(merged.fd);
+            return (1);
+        }
+        uninit_out_buffer(&buffer);
+
+#if defined(DEBUG)
+        fprintf(stderr, "%s(): merged %d runs into a level %u run "
+            "(%lld records)\n", __func__, EXTSORT_MAX_RUNS, merged.level,
+            merged.num_records);
+#endif
+
+        for(i = 0 ; i < EXTSORT_MAX_RUNS ; i++)
+            close(first[i].fd);
+        ext_sort.num_runs -= EXTSORT_MAX_RUNS;
+        ext_sort.runs[ext_sort.num_runs++] = merged;
+    }
+    return (0);
+}
+
+/* Sort in-memory file entries, write them to a new run and release them
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_sort_spill(struct file_entry **head, struct program_options *options)
+{
+    assert(head != NULL);
+    assert(options != NULL);
+
+    struct file_entry *start = *head;
+    struct file_entry **file_entry_p = NULL;
+    struct ext_run run;
+    struct out_buffer buffer;
+    fnum_t i;
+
+    if((start == NULL) || (ext_sort.num_entries == 0))
+        return (0);
+    rewind_list(start);
+
+    if(options->verbose >= OPT_VERBOSE)
+        fprintf(stderr, "Writing %lld sorted file entries to temporary "
+            "file #%u...\n", ext_sort.num_entries, ext_sort.num_runs);
+
+    /* sort entries */
+    if_not_malloc(file_entry_p,
+        sizeof(struct file_entry *) * ext_sort.num_entries,
+        return (1);
+    )
+    init_file_entry_p(file_entry_p, ext_sort.num_entries, start);
+    if(radix_sort_file_entry_p(file_entry_p, ext_sort.num_entries) != 0)
+        qsort(&file_entry_p[0], ext_sort.num_entries,
+            sizeof(struct file_entry *), &sort_file_entry_p);
+
+    /* write them */
+    if((run.fd = ext_sort_tmpfile(options)) < 0) {
+        free(file_entry_p);
+        return (1);
+    }
+    run.num_records = ext_sort.num_entries;
+    run.level = 0;
+
+    init_out_buffer(&buffer, run.fd, EXTSORT_BUFFER_SIZE);
+    for(i = 0 ; i < ext_sort.num_entries ; i++) {
+        const char *path = file_entry_path(file_entry_p[i]);
+        if((path == NULL) ||
+            (file_list_write_record(&buffer, file_entry_p[i]->size, path,
+            strlen(path)) != 0))
+            break;
+    }
+    if((i < ext_sort.num_entries) || (out_buffer_flush(&buffer) != 0) ||
+        (ext_sort_push_run(&run) != 0)) {
+        uninit_out_buffer(&buffer);
+        free(file_entry_p);
+        close(run.fd);
+        return (1);
+    }
+    uninit_out_buffer(&buffer);
+    free(file_entry_p);
+
+    /* release entries */
+    uninit_file_entries(options);
+    *head = NULL;
+    ext_sort.num_entries = 0;
+
+    return (ext_sort_compact(options));
+}
+
+/* Account for a file entry just added and spill in-memory entries to
+   a run if memory limit (option -M) is reached
+   - returns 0 (success) or 1 (failure) */
+int
+ext_sort_add(struct file_entry **head, struct program_options *options)
+{
+    assert(head != NULL);
+    assert(options != NULL);
+    assert(options->mem_limit > 0);
+
+    ext_sort.num_entries++;
+
+    if(file_entries_memory() + (ext_sort.num_entries *
+        EXTSORT_ENTRY_OVERHEAD) > options->mem_limit)
+        return (ext_sort_spill(head, options));
+    return (0);
+}
+
+/* Return the number of runs produced so far */
+unsigned int
+ext_sort_num_runs(void)
+{
+    return (ext_sort.num_runs);
+}
+
+/* Final dispatch */
+struct ext_dispatch {
+    struct partition_heap heap;     /* partitions, least-loaded first */
+    struct program_options *options;
+    struct out_files files;         /* partition files (option -o) */
+
+    struct out_buffer listing_buffer;   /* stdout listing (no -o) */
+
+    struct ext_run empties;         /* empty files */
+    struct out_buffer empties_buffer;
+};
+
+/* Write a file entry to its partition (or stdout)
+   - returns 0 (success) or 1 (failure) */
+static int
+ext_dispatch_output(struct ext_dispatch *dispatch, pnum_t index,
+    fsize_t size, const char *path, size_t path_len)
+{
+    assert(dispatch != NULL);
+    assert(path != NULL);
+
+    char *ln_term = (dispatch->options->out_zero == OPT_OUT0) ? "\0" : "\n";
+
+    /* no template provided, keep line to be printed later */
+    if(dispatch->options->out_filename == NULL) {
+        char prefix[64];
+        int prefix_len = snprintf(prefix, sizeof(prefix), "%d (%lld): ",
+            index, size);
+        uint32_t len = (uint32_t)(prefix_len + path_len + 1);
+        fsize_t unused = 0;
+
+        ext_sort.listing.num_records++;
+        if((out_buffer_write(&dispatch->listing_buffer, (char *)&unused,
+            sizeof(unused)) != 0) ||
+            (out_buffer_write(&dispatch->listing_buffer, (char *)&len,
+            sizeof(len)) != 0) ||
+            (out_buffer_write(&dispatch->listing_buffer, prefix,
+            prefix_len) != 0) ||
+            (out_buffer_write(&dispatch->listing_buffer, path,
+            path_len) != 0) ||
+            (out_buffer_write(&dispatch->listing_buffer, "\n", 1) != 0))
+            return (1);
+        return (0);
+    }
+    if((out_files_write(&dispatch->files, index, path, path_len) != 0) ||
+        (out_files_write(&dispatch->files, index, ln_term, 1) != 0))
+        return (1);
+    return (0);
+}
+
+/* Records consumer dispatching file entries (see
+   dispatch_file_entry_p_by_size()). Unless files have a cost (option -c),
+   empty files are all assigned to the same partition (adding them does not
+   change partitions' sizes) and kept aside to be re-dispatched once every
+   file has been seen */
+static int
+ext_emit_dispatch(void *ctx, fsize_t size, const char *path,
+    size_t path_len)
+{
+    assert(ctx != NULL);
+
+    struct ext_dispatch *dispatch = ctx;
+    pnum_t index = partition_heap_min_index(&dispatch->heap);
+    struct partition *partition = partition_heap_min(&dispatch->heap);
+
+#if defined(DEBUG)
+    fprintf(stderr, "%s(): %s added to partition %d (%p)\n", __func__,
+        path, index, partition);
+#endif
+    partition->size += size;
+    partition->num_files++;
+    partition_heap_update_min(&dispatch->heap);
+
+    if((size == 0) && (dispatch->options->file_cost == 0)) {
+        dispatch->empties.num_records++;
+        return (file_list_write_record(&dispatch->empties_buffer,
+            (fsize_t)index, path, path_len));
+    }
+    return (ext_dispatch_output(dispatch, index, size, path, path_len));
+}
+
+/* Records consumer re-dispatching empty files (see
+   dispatch_empty_file_entries()) ; size holds the partition index the
+   file has been assigned to */
+static int
+ext_emit_empty(void *ctx, fsize_t size, const char *path, size_t path_len)
+{
+    assert(ctx != NULL);
+
+    struct ext_dispatch *dispatch = ctx;
+    struct partition_table *partitions = dispatch->heap.table;
+    pnum_t index = (pnum_t)size;
+    fnum_t mean_files = dispatch->empties.level;
+    pnum_t j = 0;
+
+    /* associate it with the first partition having less files than
+       mean_files */
+    while(j < partitions->num_parts) {
+        struct partition *part = &partitions->parts[j];
+        if((index != j) && (part->num_files < mean_files)) {
+            get_partition_at(partitions, index)->num_files--;
+            part->num_files++;
+            index = j;
+#if defined(DEBUG)
+            fprintf(stderr, "%s(): %s (empty) re-assigned to partition "
+                "%d (%p)\n", __func__, path, index, part);
+#endif
+            break;
+        }
+        j++;
+    }
+    return (ext_dispatch_output(dispatch, index, 0, path, path_len));
+}
+
+/* Dispatch file entries spilled to runs (and remaining in-memory ones) to
+   partitions and write them to partition files (or keep them to be printed
+   by ext_sort_print_file_entries()) ; within a partition, entries are
+   written in sorted order, biggest first, empty files last
+   - returns 0 (success) or 1 (failure) */
+int
+ext_sort_dispatch(struct file_entry **head, fnum_t num_entries,
+    struct partition_table *partitions, struct program_options *options)
+{
+    assert(head != NULL);
+    assert(partitions != NULL);
+    assert(partitions->num_parts > 0);
+    assert(options != NULL);
+
+    struct ext_dispatch dispatch;
+    int error = 0;
+
+    /* spill remaining in-memory entries to get a single stream */
+    if(ext_sort_spill(head, options) != 0)
+        return (1);
+
+    dispatch.options = options;
+    if(options->out_filename != NULL) {
+        if(init_out_files(&dispatch.files, options->out_filename,
+            partitions->num_parts, OUTPUT_MAX_BUFFER_SIZE) != 0)
+            return (1);
+    }
+    else {
+        if((ext_sort.listing.fd = ext_sort_tmpfile(options)) < 0)
+            return (1);
+        ext_sort.listing.num_records = 0;
+    }
+    init_out_buffer(&dispatch.listing_buffer, ext_sort.listing.fd,
+        EXTSORT_BUFFER_SIZE);
+    if((dispatch.empties.fd = ext_sort_tmpfile(options)) < 0) {
+        if(options->out_filename != NULL)
+            uninit_out_files(&dispatch.files);
+        return (1);
+    }
+    if(init_partition_heap(&dispatch.heap, partitions,
+        options->file_cost) != 0) {
+        fprintf(stderr, "%s(): cannot init partition heap\n", __func__);
+        close(dispatch.empties.fd);
+        if(options->out_filename != NULL)
+            uninit_out_files(&dispatch.files);
+        return (1);
+    }
+    dispatch.empties.num_records = 0;
+    /* mean file entry number per partition (see ext_emit_empty()) */
+    dispatch.empties.level = num_entries / partitions->num_parts;
+    init_out_buffer(&dispatch.empties_buffer, dispatch.empties.fd,
+        EXTSORT_BUFFER_SIZE);
+
+    if(options->verbose >= OPT_VERBOSE)
+        fprintf(stderr, "Merging %u temporary file(s)...\n",
+            ext_sort.num_runs);
+
+    /* dispatch and write non-empty files, then empty ones */
+    if((ext_sort_merge(ext_sort.runs, ext_sort.num_runs, &ext_emit_dispatch,
+        &dispatch) != 0) ||
+        (out_buffer_flush(&dispatch.empties_buffer) != 0) ||
+        ((dispatch.empties.num_records > 0) &&
+        (ext_sort_merge(&dispatch.empties, 1, &ext_emit_empty,
+        &dispatch) != 0)) ||
+        ((ext_sort.listing.fd >= 0) &&
+        (out_buffer_flush(&dispatch.listing_buffer) != 0)))
+        error = 1;
+
+    uninit_out_buffer(&dispatch.listing_buffer);
+    uninit_out_buffer(&dispatch.empties_buffer);
+    close(dispatch.empties.fd);
+    if((options->out_filename != NULL) &&
+        (uninit_out_files(&dispatch.files) != 0))
+        error = 1;
+    uninit_partition_heap(&dispatch.heap);
+    return (error);
+}
+
+/* Records consumer printing lines to stdout */
+static int
+ext_emit_print(void *ctx, fsize_t size, const char *path, size_t path_len)
+{
+    assert(path != NULL);
+
+    /* listing records only hold a line to print */
+    (void)ctx;
+    (void)size;
+
+    if(fwrite(path, 1, path_len, stdout) != path_len)
+        return (1);
+    return (0);
+}
+
+/* Print file entries kept by ext_sort_dispatch() when no template has
+   been provided (see print_file_entries())
+   - returns 0 (success) or 1 (failure) */
+int
+ext_sort_print_file_entries(void)
+{
+    if((ext_sort.listing.fd < 0) || (ext_sort.listing.num_records == 0))
+        return (0);
+
+    return (ext_sort_merge(&ext_sort.listing, 1, &ext_emit_print, NULL));
+}
+
+/* Release runs */
+void
+uninit_ext_sort(void)
+{
+    unsigned int i;
+
+    for(i = 0 ; i < ext_sort.num_runs ; i++)
+        close(ext_sort.runs[i].fd);
+    if(ext_sort.runs != NULL)
+        free(ext_sort.runs);
+    ext_sort.runs = NULL;
+    ext_sort.num_runs = 0;
+    ext_sort.alloc_runs = 0;
+    ext_sort.num_entries = 0;
+    if(ext_sort.listing.fd >= 0)
+        close(ext_sort.listing.fd);
+    ext_sort.listing.fd = -1;
+    ext_sort.listing.num_records = 0;
+    return;
+}
@@ -0,0 +1,58 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _EXTSORT_H
+#define _EXTSORT_H
+
+#include "types.h"
+#include "options.h"
+#include "partition.h"
+#include "file_entry.h"
+
+#if !defined(EXTSORT_MAX_RUNS)
+#define EXTSORT_MAX_RUNS 64                 /* runs merged at once */
+#endif
+
+#if !defined(EXTSORT_BUFFER_SIZE)
+#define EXTSORT_BUFFER_SIZE (256 * 1024)    /* run read/write buffer size */
+#endif
+
+/* Memory needed to sort an in-memory file entry (see
+   radix_sort_file_entry_p()), in addition to its storage */
+#define EXTSORT_ENTRY_OVERHEAD \
+    (sizeof(struct file_entry *) + 2 * (sizeof(fsize_t) + sizeof(void *)))
+
+#define EXTSORT_TMPFILE "fpart.XXXXXX"      /* temporary files template */
+
+int ext_sort_add(struct file_entry **head, struct program_options *options);
+unsigned int ext_sort_num_runs(void);
+int ext_sort_dispatch(struct file_entry **head, fnum_t num_entries,
+    struct partition_table *partitions, struct program_options *options);
+int ext_sort_print_file_entries(void);
+void uninit_ext_sort(void);
+
+#endif /* _EXTSORT_H */
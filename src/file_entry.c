@@ -27,6 +27,11 @@
 #include "types.h"
 #include "utils.h"
 #include "options.h"
+#include "arena.h"
+#include "output.h"
+#include "extsort.h"
+#include "checkpoint.h"
+#include "file_list.h"
 #include "file_entry.h"
 
 /* stat(2) */
@@ -36,7 +41,8 @@
 /* fprintf(3) */
 #include <stdio.h>
 
-/* strerror(3), strlen(3) */
+/* strerror(3), strlen(3), strrchr(3), memcpy(3), memmove(3), memcmp(3),
+   memset(3) */
 #include <string.h>
 
 /* errno */
@@ -76,39 +82,88 @@
 /* signal(3) */
 #include <signal.h>
 
+/* posix_spawn(3) */
+#include <spawn.h>
+
 #if defined(__GNUC__)
 static void kill_child(int)  __attribute__((__noreturn__));
+static void wait_children(int)  __attribute__((__noreturn__));
 #endif
 
 /****************************
  Live-mode related functions 
  ****************************/
 
+/* An open partition */
+struct live_partition {
+    int fd;                      /* file descriptor (if option '-o' used) */
+    char *filename;              /* file name */
+    pnum_t partition_index;      /* partition number */
+    fsize_t partition_size;      /* partition size */
+    fnum_t partition_num_files;  /* number of files in partition */
+    struct out_buffer buffer;    /* partition's write buffer
+                                    (if option '-o' used) */
+};
+
 /* Status */
 static struct {
-    int fd;                      /* current file descriptor
-                                    (if option '-o' used) */
-    char *filename;              /* current file name */
-    pnum_t partition_index;      /* current partition number */
-    fsize_t partition_size;      /* current partition size */
-    fnum_t partition_num_files;  /* number of files in current partition */
+    struct live_partition *parts; /* open partitions, oldest first, followed
+                                     by free slots (option -P) */
+    unsigned int num_parts;      /* number of open partitions */
+    unsigned int *heap;          /* slots of open partitions, least-loaded
+                                    first (option -n) */
+    unsigned int num_heap;       /* number of slots in heap */
+    pnum_t next_partition_index; /* number of next partition to open */
+    struct out_buffer buffer;    /* write buffer shared by partitions
+                                    printed to stdout */
+    struct out_files files;      /* partition files (options -n and -o),
+                                    sharing a bounded amount of memory and
+                                    file descriptors */
     int exit_summary;            /* 0 if every single hook exit()ed with 0,
                                     else 1 */
     pid_t child_pid;
+    pid_t *hook_pids;            /* asynchronous hooks running (option -H) */
+    unsigned int num_hook_pids;
 } live_status = {
-    STDOUT_FILENO,
     NULL,
     0,
+    NULL,
     0,
     0,
+    { -1, NULL, 0, 0 },
+    { NULL, 0, NULL, 0, 0, NULL, NULL },
     0,
-    -1
+    -1,
+    NULL,
+    0
 };
 
-/* Signal handler, kills child and exit() */
+/* Entries held back to fill partitions (option -A), oldest first ;
+   printed entries leave holes (NULL path) that are squeezed out when
+   the end of the array is reached */
+struct live_entry {
+    char *path;
+    fsize_t size;                /* size, as reported */
+    fsize_t load;                /* size, as counted in partition */
+};
+static struct {
+    struct live_entry *entries;  /* 2 * options->live_lookahead entries */
+    unsigned int first;          /* first entry (not a hole) */
+    unsigned int end;            /* end of used entries */
+    unsigned int num_entries;    /* number of entries held back */
+} live_pending = {
+    NULL,
+    0,
+    0,
+    0
+};
+
+/* Signal handler, kills children and exit() */
 static void
 kill_child(int sig)
 {
+    unsigned int i;
+
 #if defined(DEBUG)
     fprintf(stderr, "%s(): killing child process %d\n", __func__,
         live_status.child_pid);
@@ -117,10 +172,214 @@ kill_child(int sig)
         killpg(live_status.child_pid, sig ? sig : SIGTERM);
         waitpid(live_status.child_pid, NULL, 0);
     }
+    for(i = 0 ; i < live_status.num_hook_pids ; i++) {
+        if(live_status.hook_pids[i] > 1)
+            killpg(live_status.hook_pids[i], sig ? sig : SIGTERM);
+    }
+    for(i = 0 ; i < live_status.num_hook_pids ; i++) {
+        if(live_status.hook_pids[i] > 1)
+            waitpid(live_status.hook_pids[i], NULL, 0);
+    }
     exit(EXIT_FAILURE);
 }
 
+/* Signal handler (SIGINT, with option -H), waits for children to finish
+   and exit() ; a second signal kills them */
+static void
+wait_children(int sig)
+{
+    const char msg[] = "Interrupted, waiting for running hooks to finish "
+        "(interrupt again to kill them)\n";
+    sigset_t set;
+    unsigned int i;
+
+    /* next signal kills children, let it be delivered ; our output may
+       have been interrupted too (e.g. piped to tee(1)), do not die writing
+       to it */
+    signal(SIGINT, kill_child);
+    signal(SIGPIPE, SIG_IGN);
+    sigemptyset(&set);
+    sigaddset(&set, sig);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    if(live_status.child_pid > 1) {
+        waitpid(live_status.child_pid, NULL, 0);
+        live_status.child_pid = -1;
+    }
+    for(i = 0 ; i < live_status.num_hook_pids ; i++) {
+        if(live_status.hook_pids[i] > 1) {
+            waitpid(live_status.hook_pids[i], NULL, 0);
+            live_status.hook_pids[i] = -1;
+        }
+    }
+    exit(EXIT_FAILURE);
+}
+
+/* Check the status of a terminated hook
+   - returns 0 if cmd exit()ed with 0, else returns 1 */
+static int
+hook_exit_status(const char *cmd, const struct program_options *options,
+    int child_status)
+{
+    assert(cmd != NULL);
+    assert(options != NULL);
+
+    if(WIFEXITED(child_status)) {
+        /* collect exit code */
+        if(WEXITSTATUS(child_status) != 0) {
+            if(options->verbose >= OPT_VERBOSE)
+                fprintf(stderr, "Hook '%s' exited with error %d\n",
+                    cmd, WEXITSTATUS(child_status));
+            return (1);
+        }
+        return (0);
+    }
+
+    if(options->verbose >= OPT_VERBOSE)
+        fprintf(stderr, "Hook '%s' terminated prematurely\n", cmd);
+    return (1);
+}
+
+/* Collect asynchronous hooks (option -H) that have terminated and wait for
+   others until no more than max_running hooks are left running ; their exit
+   codes are reported to live_status.exit_summary */
+static void
+wait_hooks(const struct program_options *options, unsigned int max_running)
+{
+    assert(options != NULL);
+
+    int child_status = 0;
+    pid_t wpid;
+    unsigned int i;
+
+    while(live_status.num_hook_pids > 0) {
+        wpid = waitpid(-1, &child_status,
+            (live_status.num_hook_pids > max_running) ? 0 : WNOHANG);
+        /* nothing more to collect */
+        if(wpid == 0)
+            break;
+        if(wpid == -1) {
+            if(errno == EINTR)
+                continue;
+            fprintf(stderr, "%s(): waitpid(): %s\n", __func__,
+                strerror(errno));
+            live_status.exit_summary = 1;
+            live_status.num_hook_pids = 0;
+            break;
+        }
+
+        /* forget hook */
+        for(i = 0 ; (i < live_status.num_hook_pids) &&
+            (live_status.hook_pids[i] != wpid) ; i++);
+        if(i == live_status.num_hook_pids)
+            continue;
+        live_status.hook_pids[i] =
+            live_status.hook_pids[--live_status.num_hook_pids];
+
+        if(hook_exit_status(options->post_part_hook, options,
+            child_status) != 0)
+            live_status.exit_summary = 1;
+    }
+
+    /* reset actions for signals */
+    if(live_status.num_hook_pids == 0) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGHUP, SIG_DFL);
+    }
+}
+
+/* Hooks' environment, built once and reused for every hook: a copy of
+   environ(7) followed by FPART_* variables, whose values are updated before
+   each hook is spawned */
+#define HOOK_ENV_VARS 6
+static struct {
+    char **envp;                    /* environ copy, FPART_* vars and NULL */
+    unsigned int env_size;          /* number of variables copied */
+    char *vars[HOOK_ENV_VARS];      /* FPART_* variables */
+    size_t vars_size[HOOK_ENV_VARS];/* their allocated sizes */
+    char pid[32];                   /* FPART_PID value */
+    posix_spawnattr_t attr;         /* spawn child within its own
+                                       process group */
+} hook_env;
+
+/* Build hooks' environment
+   - returns 0 (success) or 1 (failure) */
+static int
+init_hook_env(void)
+{
+    unsigned int i;
+
+    assert(hook_env.envp == NULL);
+
+    if((hook_env.envp = clone_env(HOOK_ENV_VARS, &hook_env.env_size)) == NULL)
+        return (1);
+    for(i = 0 ; i < HOOK_ENV_VARS ; i++) {
+        hook_env.vars[i] = NULL;
+        hook_env.vars_size[i] = 0;
+    }
+    snprintf(hook_env.pid, sizeof(hook_env.pid), "%d", (int)getpid());
+
+    if((posix_spawnattr_init(&hook_env.attr) != 0) ||
+        (posix_spawnattr_setflags(&hook_env.attr, POSIX_SPAWN_SETPGROUP) !=
+        0) ||
+        (posix_spawnattr_setpgroup(&hook_env.attr, 0) != 0)) {
+        fprintf(stderr, "%s(): cannot initialize spawn attributes\n",
+            __func__);
+        free(hook_env.envp);
+        hook_env.envp = NULL;
+        return (1);
+    }
+    return (0);
+}
+
+/* Release hooks' environment */
+static void
+uninit_hook_env(void)
+{
+    unsigned int i;
+
+    if(hook_env.envp == NULL)
+        return;
+
+    posix_spawnattr_destroy(&hook_env.attr);
+    for(i = 0 ; i < HOOK_ENV_VARS ; i++) {
+        if(hook_env.vars[i] != NULL)
+            free(hook_env.vars[i]);
+    }
+    free(hook_env.envp);
+    hook_env.envp = NULL;
+}
+
+/* Set the var-th FPART_* variable of hooks' environment to "name=value" ;
+   its buffer is only reallocated when it gets too small
+   - returns 0 (success) or 1 (failure) */
+static int
+hook_env_set(unsigned int var, const char *name, const char *value)
+{
+    assert(var < HOOK_ENV_VARS);
+    assert(name != NULL);
+    assert(value != NULL);
+    assert(hook_env.envp != NULL);
+
+    size_t size = strlen(name) + 1 + strlen(value) + 1;
+    if(size > hook_env.vars_size[var]) {
+        if_not_realloc(hook_env.vars[var], size,
+            hook_env.vars_size[var] = 0;
+            return (1);
+        )
+        hook_env.vars_size[var] = size;
+    }
+    snprintf(hook_env.vars[var], size, "%s=%s", name, value);
+    hook_env.envp[hook_env.env_size + var] = hook_env.vars[var];
+
+    return (0);
+}
+
 /* Executes 'cmd' and waits for it to terminate
+   - post-partition hooks are not waited for with option -H, their exit
+     codes are collected later by wait_hooks()
    - returns 0 if cmd has been executed and its return code was 0,
      else returns 1 */
 int
@@ -132,35 +391,20 @@ fpart_hook(const char *cmd, const struct program_options *options,
     assert(options != NULL);
 
     int retval = 0;
-
-    /* env variables' names */
-    char *env_fpart_hooktype_name = "FPART_HOOKTYPE";
-    char *env_fpart_partfilename_name = "FPART_PARTFILENAME";
-    char *env_fpart_partnumber_name = "FPART_PARTNUMBER";
-    char *env_fpart_partsize_name = "FPART_PARTSIZE";
-    char *env_fpart_partnumfiles_name = "FPART_PARTNUMFILES";
-    char *env_fpart_pid_name = "FPART_PID";
-
-    /* env variables' values */
-    char *env_fpart_hooktype_string = NULL;
-    char *env_fpart_partfilename_string = NULL;
-    char *env_fpart_partnumber_string = NULL;
-    char *env_fpart_partsize_string = NULL;
-    char *env_fpart_partnumfiles_string = NULL;
-    char *env_fpart_pid_string = NULL;
+    unsigned char async =
+        ((cmd == options->post_part_hook) && (options->async_hooks > 0));
+    unsigned int num_vars = 0;
+    char value[32];
 
     /* XXX As setenv(3)/unsetenv(3) are not available on all platforms, and there does not
-    seem to be a standard way of unsetting variables through putenv(3), clone current
-    environment (to avoid working on environ(7)) and add fpart variables. This is a convenient
-    way of starting from a clean environment and add only needed FPART_* variables for each hook
-    (putenv(3) would leave variables from a hook to another, even if next hooks do not need
-    them) */
-    char **envp = clone_env();
-    if(envp == NULL)
+    seem to be a standard way of unsetting variables through putenv(3), work on a copy of
+    current environment (to avoid working on environ(7)) and add fpart variables. This is a
+    convenient way of starting from a clean environment and add only needed FPART_* variables
+    for each hook (putenv(3) would leave variables from a hook to another, even if next hooks
+    do not need them). That copy is only made once */
+    if((hook_env.envp == NULL) && (init_hook_env() != 0))
         return (1);
 
-    size_t malloc_size = 1; /* empty string */
-
     /* determine the kind of hook we are in */
     if(cmd == options->pre_part_hook) {
         assert(live_partition_index != NULL);
@@ -172,18 +416,8 @@ fpart_hook(const char *cmd, const struct program_options *options,
                 *live_partition_index, cmd);
 
         /* FPART_HOOKTYPE (pre-part) */
-        malloc_size = strlen(env_fpart_hooktype_name) + 1 +
-            strlen("pre-part") + 1;
-        if_not_malloc(env_fpart_hooktype_string, malloc_size,
-            retval = 1;
-            goto cleanup;
-        )
-        snprintf(env_fpart_hooktype_string, malloc_size, "%s=%s",
-            env_fpart_hooktype_name, "pre-part");
-        if(push_env(env_fpart_hooktype_string, &envp) != 0) {
-            retval = 1;
-            goto cleanup;
-        }
+        if(hook_env_set(num_vars++, "FPART_HOOKTYPE", "pre-part") != 0)
+            return (1);
     }
     else if(cmd == options->post_part_hook) {
         assert(live_partition_index != NULL);
@@ -195,178 +429,102 @@ fpart_hook(const char *cmd, const struct program_options *options,
                 *live_partition_index, cmd);
 
         /* FPART_HOOKTYPE (post-part) */
-        malloc_size = strlen(env_fpart_hooktype_name) + 1 +
-            strlen("post-part") + 1;
-        if_not_malloc(env_fpart_hooktype_string, malloc_size,
-            retval = 1;
-            goto cleanup;
-        )
-        snprintf(env_fpart_hooktype_string, malloc_size, "%s=%s",
-            env_fpart_hooktype_name, "post-part");
-        if(push_env(env_fpart_hooktype_string, &envp) != 0) {
-            retval = 1;
-            goto cleanup;
-        }
+        if(hook_env_set(num_vars++, "FPART_HOOKTYPE", "post-part") != 0)
+            return (1);
     }
 
     /* FPART_PARTFILENAME */
     if(live_filename != NULL) {
-        malloc_size = strlen(env_fpart_partfilename_name) + 1 +
-            strlen(live_filename) + 1;
-        if_not_malloc(env_fpart_partfilename_string, malloc_size,
-            retval = 1;
-            goto cleanup;
-        )
-        snprintf(env_fpart_partfilename_string, malloc_size, "%s=%s",
-            env_fpart_partfilename_name, live_filename);
-        if(push_env(env_fpart_partfilename_string, &envp) != 0) {
-            retval = 1;
-            goto cleanup;
-        }
+        if(hook_env_set(num_vars++, "FPART_PARTFILENAME", live_filename) != 0)
+            return (1);
     }
 
     /* FPART_PARTNUMBER */
     if(live_partition_index != NULL) {
-        malloc_size = strlen(env_fpart_partnumber_name) + 1 +
-            get_num_digits(*live_partition_index) + 1;
-        if_not_malloc(env_fpart_partnumber_string, malloc_size,
-            retval = 1;
-            goto cleanup;
-        )
-        snprintf(env_fpart_partnumber_string, malloc_size, "%s=%d",
-            env_fpart_partnumber_name, *live_partition_index);
-        if(push_env(env_fpart_partnumber_string, &envp) != 0) {
-            retval = 1;
-            goto cleanup;
-        }
+        snprintf(value, sizeof(value), "%d", *live_partition_index);
+        if(hook_env_set(num_vars++, "FPART_PARTNUMBER", value) != 0)
+            return (1);
     }
 
     /* FPART_PARTSIZE */
     if(live_partition_size != NULL) {
-        malloc_size = strlen(env_fpart_partsize_name) + 1 +
-            get_num_digits(*live_partition_size) + 1;
-        if_not_malloc(env_fpart_partsize_string, malloc_size,
-            retval = 1;
-            goto cleanup;
-        )
-        snprintf(env_fpart_partsize_string, malloc_size, "%s=%lld",
-            env_fpart_partsize_name, *live_partition_size);
-        if(push_env(env_fpart_partsize_string, &envp) != 0) {
-            retval = 1;
-            goto cleanup;
-        }
+        snprintf(value, sizeof(value), "%lld", *live_partition_size);
+        if(hook_env_set(num_vars++, "FPART_PARTSIZE", value) != 0)
+            return (1);
     }
 
     /* FPART_PARTNUMFILES */
     if(live_num_files != NULL) {
-        malloc_size = strlen(env_fpart_partnumfiles_name) + 1 +
-            get_num_digits(*live_num_files) + 1;
-        if_not_malloc(env_fpart_partnumfiles_string, malloc_size,
-            retval = 1;
-            goto cleanup;
-        )
-        snprintf(env_fpart_partnumfiles_string, malloc_size, "%s=%llu",
-            env_fpart_partnumfiles_name, *live_num_files);
-        if(push_env(env_fpart_partnumfiles_string, &envp) != 0) {
-            retval = 1;
-            goto cleanup;
-        }
+        snprintf(value, sizeof(value), "%llu", *live_num_files);
+        if(hook_env_set(num_vars++, "FPART_PARTNUMFILES", value) != 0)
+            return (1);
     }
 
     /* FPART_PID */
-    pid_t fpart_pid = getpid();
-    malloc_size = strlen(env_fpart_pid_name) + 1 +
-        get_num_digits(fpart_pid) + 1;
-    if_not_malloc(env_fpart_pid_string, malloc_size,
-        retval = 1;
-        goto cleanup;
-    )
-    snprintf(env_fpart_pid_string, malloc_size, "%s=%d",
-        env_fpart_pid_name, (int)fpart_pid);
-    if(push_env(env_fpart_pid_string, &envp) != 0) {
-        retval = 1;
-        goto cleanup;
+    if(hook_env_set(num_vars++, "FPART_PID", hook_env.pid) != 0)
+        return (1);
+
+    assert(num_vars <= HOOK_ENV_VARS);
+    hook_env.envp[hook_env.env_size + num_vars] = NULL;
+
+    /* make room for a new asynchronous hook */
+    if(async) {
+        if(live_status.hook_pids == NULL) {
+            if_not_malloc(live_status.hook_pids,
+                sizeof(pid_t) * options->async_hooks,
+                return (1);
+            )
+        }
+        wait_hooks(options, options->async_hooks - 1);
+    }
+
+    /* spawn child process, as a process group leader ; posix_spawn(3)
+       avoids duplicating our address space as fork(2) would do */
+    char *argv[] = { "sh", "-c", (char *)cmd, NULL };
+    int error = posix_spawn(&live_status.child_pid, _PATH_BSHELL, NULL,
+        &hook_env.attr, argv, hook_env.envp);
+    if(error != 0) {
+        fprintf(stderr, "posix_spawn(): %s\n", strerror(error));
+        live_status.child_pid = -1;
+        return (1);
     }
 
-    /* fork child process */
+    /* child-killer signal handler */
+    signal(SIGTERM, kill_child);
+    signal(SIGINT, (options->async_hooks > 0) ? wait_children : kill_child);
+    signal(SIGHUP, kill_child);
+
+    /* asynchronous hook, do not wait for it */
+    if(async) {
+        live_status.hook_pids[live_status.num_hook_pids++] =
+            live_status.child_pid;
+        live_status.child_pid = -1;
+        return (0);
+    }
+
+    /* only wait for our child, other ones may be asynchronous hooks */
     int child_status = 0;
-    switch(live_status.child_pid = fork()) {
-        case -1:            /* error */
-            fprintf(stderr, "fork(): %s\n", strerror(errno));
-            retval = 1;
-            break;
-        case 0:             /* child */
-        {
-            /* become process group leader */
-            if(setpgid(live_status.child_pid, 0) != 0) {
-                fprintf(stderr, "%s(): setpgid(): %s\n", __func__,
-                    strerror(errno));
-                exit(EXIT_FAILURE);
-            }
-            execle(_PATH_BSHELL, "sh", "-c", cmd, (char *)NULL, envp);
-            /* if reached, error */
-            exit(EXIT_FAILURE);
-        }
-        default:            /* parent */
-        {
-            /* child-killer signal handler */
-            signal(SIGTERM, kill_child);
-            signal(SIGINT, kill_child);
-            signal(SIGHUP, kill_child);
-
-            pid_t wpid;
-            do {
-                wpid = wait(&child_status);
-            } while((wpid != live_status.child_pid) && (wpid != -1));
-
-            /* reset actions for signals */
-            signal(SIGTERM, SIG_DFL);
-            signal(SIGINT, SIG_DFL);
-            signal(SIGHUP, SIG_DFL);
-            /* reset child PID */
-            live_status.child_pid = -1;
-
-            if(wpid == -1) {
-                fprintf(stderr, "%s(): wait(): %s\n", __func__,
-                    strerror(errno));
-                retval = 1;
-            }
-            else {
-                if(WIFEXITED(child_status)) {
-                    /* collect exit code */
-                    if(WEXITSTATUS(child_status) != 0) {
-                        if(options->verbose >= OPT_VERBOSE)
-                            fprintf(stderr, "Hook '%s' exited with error %d\n",
-                                cmd, WEXITSTATUS(child_status));
-                        retval = 1;
-                    }
-                }
-                else {
-                    if(options->verbose >= OPT_VERBOSE)
-                        fprintf(stderr, "Hook '%s' terminated prematurely\n",
-                            cmd);
-                    retval = 1;
-                }
-            }
-        }
-            break;
+    pid_t wpid;
+    do {
+        wpid = waitpid(live_status.child_pid, &child_status, 0);
+    } while((wpid == -1) && (errno == EINTR));
+
+    /* reset actions for signals */
+    if(live_status.num_hook_pids == 0) {
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGHUP, SIG_DFL);
+    }
+    /* reset child PID */
+    live_status.child_pid = -1;
+
+    if(wpid == -1) {
+        fprintf(stderr, "%s(): waitpid(): %s\n", __func__, strerror(errno));
+        retval = 1;
     }
+    else
+        retval = hook_exit_status(cmd, options, child_status);
 
-cleanup:
-    if(envp != NULL)
-        free(envp);
-    if(env_fpart_hooktype_string != NULL)
-        free(env_fpart_hooktype_string);
-    if(env_fpart_partfilename_string != NULL)
-        free(env_fpart_partfilename_string);
-    if(env_fpart_partnumber_string != NULL)
-        free(env_fpart_partnumber_string);
-    if(env_fpart_partsize_string != NULL)
-        free(env_fpart_partsize_string);
-    if(env_fpart_partnumfiles_string != NULL)
-        free(env_fpart_partnumfiles_string);
-    if(env_fpart_pid_string != NULL)
-        free(env_fpart_pid_string);
     return (retval);
 }
 
@@ -377,15 +535,334 @@ handle_file_entry(struct file_entry **head, char *path, fsize_t size,
 {
     assert(options != NULL);
 
+    /* save entry to binary file list (option -O) */
+    if((options->list_filename != NULL) && (file_list_write(path, size) != 0))
+        return (1);
+
     if(options->live_mode == OPT_LIVEMODE)
         return (live_print_file_entry(path, size, options));
-    else
-        return (add_file_entry(head, path, size, options));
+
+    if(add_file_entry(head, path, size, options) != 0)
+        return (1);
+
+    /* spill file entries to disk if memory limit is reached */
+    if(options->mem_limit > 0)
+        return (ext_sort_add(head, options));
+    /* flush file entries to partitions if checkpoint is reached */
+    if(options->checkpoint_entries > 0)
+        return (checkpoint_add(head, options));
+    return (0);
 }
 
-/* Print a file entry */
-int
-live_print_file_entry(char *path, fsize_t size,
+/* Return the write buffer of an open partition */
+static struct out_buffer *
+live_partition_buffer(struct live_partition *part,
+    const struct program_options *options)
+{
+    assert(part != NULL);
+    assert(options != NULL);
+
+    return ((options->out_filename != NULL) ?
+        &part->buffer : &live_status.buffer);
+}
+
+/* Return the maximum number of partitions open at once: every partition
+   with option -n, else option -P's value */
+static unsigned int
+live_max_open_parts(const struct program_options *options)
+{
+    assert(options != NULL);
+
+    return ((options->num_parts != DFLT_OPT_NUM_PARTS) ?
+        options->num_parts : options->live_open_parts);
+}
+
+/* Allocate slots for open partitions and prepare write buffers (reused for
+   every partition) ; with options -n and -o, partition files are written
+   through a set of output files instead
+   - returns 0 (success) or 1 (failure) */
+static int
+init_live_partitions(const struct program_options *options)
+{
+    assert(options != NULL);
+    assert(options->live_open_parts > 0);
+    assert(live_status.parts == NULL);
+    assert(live_status.heap == NULL);
+
+    unsigned int max_open_parts = live_max_open_parts(options);
+    unsigned int i;
+
+    if_not_malloc(live_status.parts,
+        sizeof(struct live_partition) * max_open_parts,
+        return (1);
+    )
+    if(options->num_parts != DFLT_OPT_NUM_PARTS) {
+        if_not_malloc(live_status.heap, sizeof(unsigned int) * max_open_parts,
+            free(live_status.parts);
+            live_status.parts = NULL;
+            return (1);
+        )
+        live_status.num_heap = 0;
+
+        if((options->out_filename != NULL) &&
+            (init_out_files(&live_status.files, options->out_filename,
+            options->num_parts, options->live_buffer_size) != 0)) {
+            free(live_status.heap);
+            live_status.heap = NULL;
+            free(live_status.parts);
+            live_status.parts = NULL;
+            return (1);
+        }
+    }
+    for(i = 0 ; i < max_open_parts ; i++) {
+        live_status.parts[i].fd = -1;
+        live_status.parts[i].filename = NULL;
+        live_status.parts[i].partition_index = 0;
+        live_status.parts[i].partition_size = 0;
+        live_status.parts[i].partition_num_files = 0;
+        init_out_buffer(&live_status.parts[i].buffer, -1,
+            options->live_buffer_size);
+    }
+    init_out_buffer(&live_status.buffer, STDOUT_FILENO,
+        options->live_buffer_size);
+    return (0);
+}
+
+/* Open next partition, in first free slot: execute pre-partition hook and
+   create its file (with option -n, files are created by
+   live_open_partitions())
+   - returns 0 (success) or 1 (failure) */
+static int
+live_open_partition(struct program_options *options)
+{
+    assert(options != NULL);
+    assert(live_status.num_parts < live_max_open_parts(options));
+
+    char *out_template = options->out_filename;
+    struct live_partition *part = &live_status.parts[live_status.num_parts];
+
+    part->partition_index = live_status.next_partition_index;
+    part->partition_size = options->preload_size;
+    part->partition_num_files = 0;
+
+    if(out_template != NULL) {
+        /* compute part->filename "out_template.i\0" */
+        size_t malloc_size = strlen(out_template) + 1 +
+            get_num_digits(part->partition_index) + 1;
+        if_not_malloc(part->filename, malloc_size,
+            return (1);
+        )
+        snprintf(part->filename, malloc_size, "%s.%d", out_template,
+            part->partition_index);
+    }
+
+    /* execute pre-partition hook */
+    if(options->pre_part_hook != NULL) {
+        if(fpart_hook(options->pre_part_hook, options, part->filename,
+            &part->partition_index, &part->partition_size,
+            &part->partition_num_files) != 0)
+            live_status.exit_summary = 1;
+    }
+
+    if((out_template != NULL) && (options->num_parts == DFLT_OPT_NUM_PARTS)) {
+        /* open file */
+        if((part->fd =
+            open(part->filename, O_WRONLY|O_CREAT|O_TRUNC, 0660)) < 0) {
+            fprintf(stderr, "%s: %s\n", part->filename, strerror(errno));
+            free(part->filename);
+            part->filename = NULL;
+            return (1);
+        }
+        part->buffer.fd = part->fd;
+    }
+
+    live_status.num_parts++;
+    live_status.next_partition_index++;
+    return (0);
+}
+
+/* Close open partition i: flush and close its file, execute post-partition
+   hook and release its slot
+   - returns 0 (success) or 1 (failure) */
+static int
+live_close_partition(unsigned int i, struct program_options *options)
+{
+    assert(options != NULL);
+    assert(i < live_status.num_parts);
+
+    struct live_partition *part = &live_status.parts[i];
+    assert(part->partition_num_files > 0);
+
+    /* display added partition */
+    if(options->verbose >= OPT_VERBOSE)
+        fprintf(stderr, "Filled part #%d: size = %lld, %lld file(s)\n",
+            part->partition_index, part->partition_size,
+            part->partition_num_files);
+
+    /* flush buffer before hook execution and close fd */
+    if(out_buffer_flush(live_partition_buffer(part, options)) != 0)
+        return (1);
+    if(options->out_filename != NULL) {
+        close(part->fd);
+        part->fd = -1;
+        part->buffer.fd = -1;
+    }
+
+    /* execute post-partition hook */
+    if(options->post_part_hook != NULL) {
+        if(fpart_hook(options->post_part_hook, options,
+            part->filename, &part->partition_index,
+            &part->partition_size,
+            &part->partition_num_files) != 0)
+            live_status.exit_summary = 1;
+    }
+
+    if(options->out_filename != NULL) {
+        free(part->filename);
+        part->filename = NULL;
+    }
+
+    /* keep open partitions ordered, slot becomes the first free one */
+    struct live_partition slot = *part;
+    memmove(&live_status.parts[i], &live_status.parts[i + 1],
+        sizeof(struct live_partition) * (live_status.num_parts - i - 1));
+    live_status.num_parts--;
+    live_status.parts[live_status.num_parts] = slot;
+    return (0);
+}
+
+/* Return 1 if an entry loading load bytes can be added to open partition
+   part without exceeding limits, else 0 */
+static int
+live_partition_fits(const struct live_partition *part, fsize_t load,
+    const struct program_options *options)
+{
+    assert(part != NULL);
+    assert(options != NULL);
+
+    if((options->max_entries > 0) &&
+        (part->partition_num_files >= options->max_entries))
+        return (0);
+    return ((options->max_size == 0) ||
+        ((part->partition_size + load) <= options->max_size));
+}
+
+/* Return 1 if open partition in slot a must be placed above partition in
+   slot b within the heap (option -n), i.e. if it costs less or (same cost)
+   holds fewer files or (same number of files) has a lower index */
+static int
+live_heap_lower(unsigned int a, unsigned int b,
+    const struct program_options *options)
+{
+    assert(options != NULL);
+    assert(a < live_status.num_parts);
+    assert(b < live_status.num_parts);
+
+    struct live_partition *pa = &live_status.parts[a];
+    struct live_partition *pb = &live_status.parts[b];
+
+    fsize_t ca = pa->partition_size +
+        (options->file_cost * (fsize_t)pa->partition_num_files);
+    fsize_t cb = pb->partition_size +
+        (options->file_cost * (fsize_t)pb->partition_num_files);
+    if(ca != cb)
+        return (ca < cb);
+    if(pa->partition_num_files != pb->partition_num_files)
+        return (pa->partition_num_files < pb->partition_num_files);
+    return (pa->partition_index < pb->partition_index);
+}
+
+/* Sift heap element at position i down to its final position */
+static void
+live_heap_sift_down(unsigned int i, const struct program_options *options)
+{
+    assert(live_status.heap != NULL);
+    assert(options != NULL);
+
+    while(1) {
+        unsigned int smallest = i;
+        unsigned int left = (2 * i) + 1;
+        unsigned int right = left + 1;
+        if((left < live_status.num_heap) &&
+            live_heap_lower(live_status.heap[left],
+            live_status.heap[smallest], options))
+            smallest = left;
+        if((right < live_status.num_heap) &&
+            live_heap_lower(live_status.heap[right],
+            live_status.heap[smallest], options))
+            smallest = right;
+        if(smallest == i)
+            break;
+
+        unsigned int tmp = live_status.heap[i];
+        live_status.heap[i] = live_status.heap[smallest];
+        live_status.heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/* Open every partition at once (option -n): execute pre-partition hooks,
+   create partition files and index partitions within heap
+   - returns 0 (success) or 1 (failure) */
+static int
+live_open_partitions(struct program_options *options)
+{
+    assert(options != NULL);
+    assert(options->num_parts != DFLT_OPT_NUM_PARTS);
+    assert(live_status.num_parts == 0);
+
+    unsigned int i;
+
+    for(i = 0 ; i < options->num_parts ; i++) {
+        if(live_open_partition(options) != 0)
+            return (1);
+    }
+    if((options->out_filename != NULL) &&
+        (out_files_flush(&live_status.files) != 0))
+        return (1);
+
+    /* partitions are empty, ordering them by index gives a valid heap */
+    for(i = 0 ; i < live_status.num_parts ; i++)
+        live_status.heap[i] = i;
+    live_status.num_heap = live_status.num_parts;
+    return (0);
+}
+
+/* Return the open partition an entry loading load bytes goes to, or
+   live_status.num_parts if a new one must be opened
+   - with option -n, the entry goes to the least-loaded partition
+     (online greedy)
+   - with a single open partition, any entry goes to it
+     (it is closed once full)
+   - else, the entry goes to the fullest partition it fits in (best fit) */
+static unsigned int
+live_find_partition(fsize_t load, const struct program_options *options)
+{
+    assert(options != NULL);
+
+    if(options->num_parts != DFLT_OPT_NUM_PARTS) {
+        assert(live_status.num_heap == options->num_parts);
+        return (live_status.heap[0]);
+    }
+
+    if(options->live_open_parts == 1)
+        return (0);
+
+    unsigned int best = live_status.num_parts;
+    unsigned int i;
+    for(i = 0 ; i < live_status.num_parts ; i++) {
+        struct live_partition *part = &live_status.parts[i];
+        if(live_partition_fits(part, load, options) &&
+            ((best == live_status.num_parts) || (part->partition_size >
+            live_status.parts[best].partition_size)))
+            best = i;
+    }
+    return (best);
+}
+
+/* Add a file entry to a live partition and print it */
+static int
+live_add_file_entry(char *path, fsize_t size,
     struct program_options *options)
 {
     assert(path != NULL);
@@ -394,65 +871,63 @@ live_print_file_entry(char *path, fsize_t size,
 
     char *out_template = options->out_filename;
     char *ln_term = (options->out_zero == OPT_OUT0) ? "\0" : "\n";
+    fsize_t load =
+        round_num(size + options->overload_size, options->round_size);
 
-    /* beginning of a new partition */
-    if(live_status.partition_num_files == 0) {
-        /* very first pass of first partition, preload first partition */
-        if(live_status.partition_index == 0)
-            live_status.partition_size = options->preload_size;
-
-        if(out_template != NULL) {
-            /* compute live_status.filename "out_template.i\0" */
-            size_t malloc_size = strlen(out_template) + 1 +
-                get_num_digits(live_status.partition_index) + 1;
-            if_not_malloc(live_status.filename, malloc_size,
-                return (1);
-            )
-            snprintf(live_status.filename, malloc_size, "%s.%d", out_template,
-                live_status.partition_index);
-        }
-
-        /* execute pre-partition hook */
-        if(options->pre_part_hook != NULL) {
-            if(fpart_hook(options->pre_part_hook, options, live_status.filename,
-                &live_status.partition_index, &live_status.partition_size,
-                &live_status.partition_num_files) != 0)
-                live_status.exit_summary = 1;
-        }
+    /* very first pass */
+    if(live_status.parts == NULL) {
+        if(init_live_partitions(options) != 0)
+            return (1);
+        if((options->num_parts != DFLT_OPT_NUM_PARTS) &&
+            (live_open_partitions(options) != 0))
+            return (1);
+    }
 
-        if(out_template != NULL) {
-            /* open file */
-            if((live_status.fd =
-                open(live_status.filename, O_WRONLY|O_CREAT|O_TRUNC, 0660)) < 0) {
-                fprintf(stderr, "%s: %s\n", live_status.filename,
-                    strerror(errno));
-                free(live_status.filename);
-                live_status.filename = NULL;
-                return (1);
-            }
-        }
+    /* find a partition, or open a new one (closing the oldest one if too
+       many partitions are open) */
+    unsigned int i = live_find_partition(load, options);
+    if(i == live_status.num_parts) {
+        if((live_status.num_parts == live_max_open_parts(options)) &&
+            (live_close_partition(0, options) != 0))
+            return (1);
+        if(live_open_partition(options) != 0)
+            return (1);
+        i = live_status.num_parts - 1;
     }
+    struct live_partition *part = &live_status.parts[i];
+    struct out_buffer *buffer = live_partition_buffer(part, options);
 
     /* count file in */
-    live_status.partition_size +=
-        round_num(size + options->overload_size, options->round_size);
-    live_status.partition_num_files++;
+    part->partition_size += load;
+    part->partition_num_files++;
+    if(options->num_parts != DFLT_OPT_NUM_PARTS)
+        live_heap_sift_down(0, options);
 
+    /* print to stdout (no template provided) or to fd, through our write
+       buffer */
     if(out_template == NULL) {
-        /* no template provided, just print to stdout */
-        fprintf(stdout, "%d (%lld): %s\n", live_status.partition_index, size,
-            path);
+        char prefix[64];
+        int prefix_len = snprintf(prefix, sizeof(prefix), "%d (%lld): ",
+            part->partition_index, size);
+        if((out_buffer_write(buffer, prefix, prefix_len) != 0) ||
+            (out_buffer_write(buffer, path, strlen(path)) != 0) ||
+            (out_buffer_write(buffer, "\n", 1) != 0))
+            return (1);
+    }
+    else if(options->num_parts != DFLT_OPT_NUM_PARTS) {
+        if((out_files_write(&live_status.files, part->partition_index, path,
+            strlen(path)) != 0) ||
+            (out_files_write(&live_status.files, part->partition_index,
+            ln_term, 1) != 0))
+            return (1);
     }
     else {
-        /* print to fd */
-        size_t to_write = strlen(path);
-        if((write(live_status.fd, path, to_write) != (ssize_t)to_write) ||
-            (write(live_status.fd, ln_term, 1) != 1)) {
-            fprintf(stderr, "%s\n", strerror(errno));
-            /* do not close(livefd) and free(live_status.filename) here because
-               it will be useful and free'd in uninit_file_entries() below */
+        /* do not close(part->fd) and free(part->filename) on error
+           because it will be useful and free'd in uninit_file_entries()
+           below */
+        if((out_buffer_write(buffer, path, strlen(path)) != 0) ||
+            (out_buffer_write(buffer, ln_term, 1) != 0))
             return (1);
-        }
     }
 
     /* display added filename */
@@ -461,41 +936,127 @@ live_print_file_entry(char *path, fsize_t size,
 
     /* if end of partition reached */
     if(((options->max_entries > 0) && 
-            (live_status.partition_num_files >= options->max_entries)) ||
+            (part->partition_num_files >= options->max_entries)) ||
         ((options->max_size > 0) && 
-            (live_status.partition_size >= options->max_size))) {
-        /* display added partition */
-        if(options->verbose >= OPT_VERBOSE)
-            fprintf(stderr, "Filled part #%d: size = %lld, %lld file(s)\n",
-                live_status.partition_index, live_status.partition_size,
-                live_status.partition_num_files);
+            (part->partition_size >= options->max_size)))
+        return (live_close_partition(i, options));
 
-        /* close fd or flush buffer */
-        if(out_template == NULL)
-            fflush(stdout);
-        else
-            close(live_status.fd);
-
-        /* execute post-partition hook */
-        if(options->post_part_hook != NULL) {
-            if(fpart_hook(options->post_part_hook, options,
-                live_status.filename, &live_status.partition_index,
-                &live_status.partition_size,
-                &live_status.partition_num_files) != 0)
-                live_status.exit_summary = 1;
-        }
+    return (0);
+}
 
-        if(out_template != NULL) {
-            free(live_status.filename);
-            live_status.filename = NULL;
-        }
+/* Return 1 if an entry loading load bytes can be added to current live
+   partition (the single open one, option -A cannot be used with -P) without
+   exceeding limits, else 0 (a new partition accepts any entry) */
+static int
+live_fits(fsize_t load, const struct program_options *options)
+{
+    assert(options != NULL);
+    assert(options->live_open_parts == 1);
+
+    if(live_status.num_parts == 0)
+        return (1);
+    return (live_partition_fits(&live_status.parts[0], load, options));
+}
+
+/* Print an entry held back (option -A): the oldest one that fits in current
+   partition, else close that partition and start the next one with the
+   oldest entry
+   - returns 0 (success) or 1 (failure) */
+static int
+live_release_pending(struct program_options *options)
+{
+    assert(options != NULL);
+    assert(live_pending.num_entries > 0);
+
+    unsigned int i = live_pending.first;
+    while((i < live_pending.end) && ((live_pending.entries[i].path == NULL) ||
+        !live_fits(live_pending.entries[i].load, options)))
+        i++;
+
+    /* no entry fits, partition cannot be filled further */
+    if(i == live_pending.end) {
+        if(live_close_partition(0, options) != 0)
+            return (1);
+        i = live_pending.first;
+    }
+
+    /* leave a hole */
+    struct live_entry entry = live_pending.entries[i];
+    live_pending.entries[i].path = NULL;
+    live_pending.num_entries--;
+    while((live_pending.first < live_pending.end) &&
+        (live_pending.entries[live_pending.first].path == NULL))
+        live_pending.first++;
+
+    int retval = live_add_file_entry(entry.path, entry.size, options);
+    free(entry.path);
+    return (retval);
+}
+
+/* Print a file entry, or hold it back to fill partitions (option -A) */
+int
+live_print_file_entry(char *path, fsize_t size,
+    struct program_options *options)
+{
+    assert(path != NULL);
+    assert(options != NULL);
+    assert(options->live_mode == OPT_LIVEMODE);
 
-        /* reset current partition status */
-        live_status.partition_index++;
-        live_status.partition_size = options->preload_size;
-        live_status.partition_num_files = 0;
+    if(options->live_lookahead == 0)
+        return (live_add_file_entry(path, size, options));
+
+    if(live_pending.entries == NULL) {
+        if_not_malloc(live_pending.entries,
+            sizeof(struct live_entry) * 2 * options->live_lookahead,
+            return (1);
+        )
     }
 
+    /* window full, make room */
+    if((live_pending.num_entries == options->live_lookahead) &&
+        (live_release_pending(options) != 0))
+        return (1);
+
+    /* end of array reached, squeeze holes out */
+    if(live_pending.end == (2 * options->live_lookahead)) {
+        unsigned int i;
+        live_pending.end = 0;
+        for(i = live_pending.first ; i < (2 * options->live_lookahead) ; i++) {
+            if(live_pending.entries[i].path != NULL)
+                live_pending.entries[live_pending.end++] =
+                    live_pending.entries[i];
+        }
+        live_pending.first = 0;
+    }
+
+    struct live_entry *entry = &live_pending.entries[live_pending.end];
+    size_t malloc_size = strlen(path) + 1;
+    if_not_malloc(entry->path, malloc_size,
+        return (1);
+    )
+    memcpy(entry->path, path, malloc_size);
+    entry->size = size;
+    entry->load = round_num(size + options->overload_size, options->round_size);
+    live_pending.end++;
+    live_pending.num_entries++;
+    return (0);
+}
+
+/* Print every entry still held back (option -A) and flush partition files
+   (options -n and -o)
+   - returns 0 (success) or 1 (failure) */
+int
+live_flush_file_entries(struct program_options *options)
+{
+    assert(options != NULL);
+    assert(options->live_mode == OPT_LIVEMODE);
+
+    while(live_pending.num_entries > 0) {
+        if(live_release_pending(options) != 0)
+            return (1);
+    }
+    if(live_status.files.files != NULL)
+        return (out_files_flush(&live_status.files));
     return (0);
 }
 
@@ -503,6 +1064,338 @@ live_print_file_entry(char *path, fsize_t size,
  Double-linked list of file_entries manipulation functions
  *********************************************************/
 
+/* File entries and their paths are allocated from arenas and released
+   at once by uninit_file_entries(). Paths are split into a directory part,
+   shared between entries through a tree of dir_node structures, and a leaf
+   name. To build that tree, we keep track of the last directory used (and
+   its ancestors): crawling returns files from the same directory one after
+   the other */
+static struct {
+    struct arena entries;           /* file_entry structures */
+    struct arena dirs;              /* dir_node structures */
+    struct arena paths;             /* packed names */
+    size_t path_bytes;              /* size of full paths added */
+
+    struct dir_node **dir_stack;    /* last directory and its ancestors */
+    unsigned int dir_depth;         /* number of directories in stack */
+    unsigned int dir_stack_size;    /* allocated stack size */
+    char *dir_path;                 /* full path of last directory */
+    size_t dir_path_size;           /* allocated size for dir_path */
+
+    struct dir_node **dir_hash;     /* hash table of known directories */
+    size_t dir_hash_size;           /* number of slots (power of 2) */
+    size_t num_dirs;                /* number of directories */
+
+    char *path_buf;                 /* buffer used to rebuild paths */
+    size_t path_buf_size;           /* allocated size for path_buf */
+
+    unsigned char initialized;
+} fe_storage = {
+    .initialized = 0
+};
+
+/* Initialize file entries storage on first use */
+static void
+init_fe_storage(void)
+{
+    if(fe_storage.initialized)
+        return;
+    init_arena(&fe_storage.entries,
+        sizeof(struct file_entry) * FE_ARENA_ENTRIES);
+    init_arena(&fe_storage.dirs, 0);
+    init_arena(&fe_storage.paths, 0);
+    fe_storage.path_bytes = 0;
+    fe_storage.dir_stack = NULL;
+    fe_storage.dir_depth = 0;
+    fe_storage.dir_stack_size = 0;
+    fe_storage.dir_path = NULL;
+    fe_storage.dir_path_size = 0;
+    fe_storage.dir_hash = NULL;
+    fe_storage.dir_hash_size = 0;
+    fe_storage.num_dirs = 0;
+    fe_storage.path_buf = NULL;
+    fe_storage.path_buf_size = 0;
+    fe_storage.initialized = 1;
+    return;
+}
+
+/* Release file entries storage */
+static void
+uninit_fe_storage(void)
+{
+    if(!fe_storage.initialized)
+        return;
+    uninit_arena(&fe_storage.paths);
+    uninit_arena(&fe_storage.dirs);
+    uninit_arena(&fe_storage.entries);
+    if(fe_storage.dir_stack != NULL)
+        free(fe_storage.dir_stack);
+    if(fe_storage.dir_path != NULL)
+        free(fe_storage.dir_path);
+    if(fe_storage.dir_hash != NULL)
+        free(fe_storage.dir_hash);
+    if(fe_storage.path_buf != NULL)
+        free(fe_storage.path_buf);
+    fe_storage.initialized = 0;
+    return;
+}
+
+/* Compute hash value of a directory, given its parent and name */
+static size_t
+dir_node_hash(const struct dir_node *parent, const char *name, size_t len)
+{
+    /* FNV-1a */
+    size_t hash = (size_t)2166136261U ^ (size_t)parent;
+    size_t i = 0;
+    while(i < len) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619U;
+        i++;
+    }
+    return (hash);
+}
+
+/* Insert a directory into the hash table of known directories
+   - returns 0 (success) or 1 (failure) */
+static int
+insert_dir_node(struct dir_node *node)
+{
+    assert(node != NULL);
+
+    /* keep load factor under 1/2 */
+    if((fe_storage.num_dirs + 1) * 2 > fe_storage.dir_hash_size) {
+        size_t new_size = max(fe_storage.dir_hash_size * 2, 1024);
+        struct dir_node **new_hash = NULL;
+        if_not_malloc(new_hash, sizeof(struct dir_node *) * new_size,
+            return (1);
+        )
+        memset(new_hash, 0, sizeof(struct dir_node *) * new_size);
+
+        /* re-hash known directories */
+        size_t i = 0;
+        while(i < fe_storage.dir_hash_size) {
+            struct dir_node *cur = fe_storage.dir_hash[i];
+            if(cur != NULL) {
+                size_t parent_len =
+                    (cur->parentp != NULL) ? cur->parentp->len : 0;
+                size_t j = dir_node_hash(cur->parentp, cur->name,
+                    cur->len - parent_len) & (new_size - 1);
+                while(new_hash[j] != NULL)
+                    j = (j + 1) & (new_size - 1);
+                new_hash[j] = cur;
+            }
+            i++;
+        }
+        if(fe_storage.dir_hash != NULL)
+            free(fe_storage.dir_hash);
+        fe_storage.dir_hash = new_hash;
+        fe_storage.dir_hash_size = new_size;
+    }
+
+    size_t parent_len = (node->parentp != NULL) ? node->parentp->len : 0;
+    size_t i = dir_node_hash(node->parentp, node->name,
+        node->len - parent_len) & (fe_storage.dir_hash_size - 1);
+    while(fe_storage.dir_hash[i] != NULL)
+        i = (i + 1) & (fe_storage.dir_hash_size - 1);
+    fe_storage.dir_hash[i] = node;
+    fe_storage.num_dirs++;
+    return (0);
+}
+
+/* Find a known directory, given its parent and name
+   - returns NULL if not found */
+static struct dir_node *
+find_dir_node(const struct dir_node *parent, const char *name, size_t len)
+{
+    if(fe_storage.dir_hash_size == 0)
+        return (NULL);
+
+    size_t parent_len = (parent != NULL) ? parent->len : 0;
+    size_t i = dir_node_hash(parent, name, len) &
+        (fe_storage.dir_hash_size - 1);
+    while(fe_storage.dir_hash[i] != NULL) {
+        struct dir_node *cur = fe_storage.dir_hash[i];
+        if((cur->parentp == parent) && (cur->len == parent_len + len) &&
+            (memcmp(cur->name, name, len) == 0))
+            return (cur);
+        i = (i + 1) & (fe_storage.dir_hash_size - 1);
+    }
+    return (NULL);
+}
+
+/* Split path into a directory node and a leaf name
+   - the directory part of path ends with its last slash ; each directory
+     is stored once and looked up from the previous path added first
+   - returns 0 (success) or 1 (failure) */
+static int
+split_file_entry_path(const char *path, struct dir_node **dir, char **name)
+{
+    assert(path != NULL);
+    assert(dir != NULL);
+    assert(name != NULL);
+    assert(fe_storage.initialized);
+
+    const char *leaf = strrchr(path, '/');
+    leaf = (leaf == NULL) ? path : leaf + 1;
+    size_t dir_len = leaf - path;
+
+    /* find the deepest directory shared with previous path */
+    size_t common_len = 0;
+    if(fe_storage.dir_depth > 0) {
+        size_t last_len = fe_storage.dir_stack[fe_storage.dir_depth - 1]->len;
+        while((common_len < dir_len) && (common_len < last_len) &&
+            (path[common_len] == fe_storage.dir_path[common_len]))
+            common_len++;
+    }
+    while(fe_storage.dir_depth > 0) {
+        struct dir_node *last = fe_storage.dir_stack[fe_storage.dir_depth - 1];
+        /* directory must be a prefix of path and end at the same place */
+        if((last->len <= common_len) &&
+            ((last->len == dir_len) || (path[last->len] != '/')))
+            break;
+        fe_storage.dir_depth--;
+    }
+
+    /* make room for new directory path */
+    if(dir_len + 1 > fe_storage.dir_path_size) {
+        size_t alloc_size = max(fe_storage.dir_path_size * 2, dir_len + 1);
+        if_not_realloc(fe_storage.dir_path, alloc_size,
+            fe_storage.dir_path_size = 0;
+            fe_storage.dir_depth = 0;
+            return (1);
+        )
+        fe_storage.dir_path_size = alloc_size;
+    }
+    memcpy(fe_storage.dir_path, path, dir_len);
+    fe_storage.dir_path[dir_len] = '\0';
+
+    /* add missing directories, one path component at a time */
+    size_t pos = (fe_storage.dir_depth > 0) ?
+        fe_storage.dir_stack[fe_storage.dir_depth - 1]->len : 0;
+    while(pos < dir_len) {
+        /* component ends after its last consecutive slash */
+        size_t end = pos;
+        while(path[end] != '/')
+            end++;
+        while((end < dir_len) && (path[end] == '/'))
+            end++;
+
+        if(fe_storage.dir_depth >= fe_storage.dir_stack_size) {
+            unsigned int alloc_size = max(fe_storage.dir_stack_size * 2, 16);
+            if_not_realloc(fe_storage.dir_stack,
+                sizeof(struct dir_node *) * alloc_size,
+                fe_storage.dir_stack_size = 0;
+                fe_storage.dir_depth = 0;
+                return (1);
+            )
+            fe_storage.dir_stack_size = alloc_size;
+        }
+
+        struct dir_node *parent = (fe_storage.dir_depth > 0) ?
+            fe_storage.dir_stack[fe_storage.dir_depth - 1] : NULL;
+        struct dir_node *node = find_dir_node(parent, &path[pos], end - pos);
+        if(node == NULL) {
+            if((node = arena_alloc(&fe_storage.dirs,
+                sizeof(struct dir_node))) == NULL)
+                return (1);
+            if((node->name = arena_strndup(&fe_storage.paths, &path[pos],
+                end - pos)) == NULL)
+                return (1);
+            node->len = end;
+            node->parentp = parent;
+            if(insert_dir_node(node) != 0)
+                return (1);
+        }
+
+        fe_storage.dir_stack[fe_storage.dir_depth] = node;
+        fe_storage.dir_depth++;
+        pos = end;
+    }
+
+    *dir = (fe_storage.dir_depth > 0) ?
+        fe_storage.dir_stack[fe_storage.dir_depth - 1] : NULL;
+    if((*name = arena_strdup(&fe_storage.paths, leaf)) == NULL)
+        return (1);
+
+    fe_storage.path_bytes += dir_len + strlen(leaf) + 1;
+    return (0);
+}
+
+/* Rebuild the full path of a file entry
+   - returned string is overwritten by subsequent calls
+   - returns NULL if memory cannot be allocated */
+const char *
+file_entry_path(const struct file_entry *fe)
+{
+    assert(fe != NULL);
+    assert(fe->name != NULL);
+    assert(fe_storage.initialized);
+
+    size_t dir_len = (fe->dir != NULL) ? fe->dir->len : 0;
+    size_t name_len = strlen(fe->name);
+
+    if(dir_len + name_len + 1 > fe_storage.path_buf_size) {
+        size_t alloc_size =
+            max(fe_storage.path_buf_size * 2, dir_len + name_len + 1);
+        if_not_realloc(fe_storage.path_buf, alloc_size,
+            fe_storage.path_buf_size = 0;
+            return (NULL);
+        )
+        fe_storage.path_buf_size = alloc_size;
+    }
+
+    /* copy leaf name and then each directory, backwards */
+    memcpy(&fe_storage.path_buf[dir_len], fe->name, name_len + 1);
+    struct dir_node *node = fe->dir;
+    while(node != NULL) {
+        size_t parent_len =
+            (node->parentp != NULL) ? node->parentp->len : 0;
+        memcpy(&fe_storage.path_buf[parent_len], node->name,
+            node->len - parent_len);
+        node = node->parentp;
+    }
+    return (fe_storage.path_buf);
+}
+
+/* Return memory currently used by file entries storage */
+size_t
+file_entries_memory(void)
+{
+    if(!fe_storage.initialized)
+        return (0);
+
+    return (fe_storage.entries.chunk_bytes + fe_storage.dirs.chunk_bytes +
+        fe_storage.paths.chunk_bytes +
+        (fe_storage.dir_hash_size * sizeof(struct dir_node *)));
+}
+
+/* Print memory used by file entries storage and an estimate of memory
+   saved by not allocating each file entry and path separately */
+void
+print_file_entries_memory(void)
+{
+    if(!fe_storage.initialized)
+        return;
+
+    size_t used = fe_storage.entries.chunk_bytes +
+        fe_storage.dirs.chunk_bytes + fe_storage.paths.chunk_bytes;
+    size_t malloc_used = fe_storage.entries.malloc_bytes +
+        fe_storage.dirs.malloc_bytes + fe_storage.paths.malloc_bytes;
+
+    fprintf(stderr, "%zu bytes used to store file entries "
+        "(%zu bytes saved, %llu allocations avoided).\n", used,
+        (malloc_used > used) ? (malloc_used - used) : 0,
+        (fe_storage.entries.num_objects + fe_storage.dirs.num_objects +
+        fe_storage.paths.num_objects) -
+        (fe_storage.entries.num_chunks + fe_storage.dirs.num_chunks +
+        fe_storage.paths.num_chunks));
+    fprintf(stderr, "%zu bytes used to store %zu bytes of paths.\n",
+        fe_storage.dirs.chunk_bytes + fe_storage.paths.chunk_bytes +
+        (fe_storage.dir_hash_size * sizeof(struct dir_node *)),
+        fe_storage.path_bytes);
+    return;
+}
+
 /* Add a file entry to a double-linked list of file_entries
    - if head is NULL, creates a new file entry ; if not, chains a new file
      entry to it
@@ -519,26 +1412,26 @@ add_file_entry(struct file_entry **head, char *path, fsize_t size,
     struct file_entry **current = head; /* current file_entry pointer address */
     struct file_entry *previous = NULL; /* previous file_entry pointer */
 
+    init_fe_storage();
+
     /* backup current structure pointer and initialize a new structure */
     previous = *current;
 
-    if_not_malloc(*current, sizeof(struct file_entry),
+    if((*current = arena_alloc(&fe_storage.entries,
+        sizeof(struct file_entry))) == NULL) {
+        *current = previous;
         return (1);
-    )
+    }
 
     /* set head on first call */
     if(*head == NULL)
         *head = *current;
 
     /* set current file data */
-    size_t malloc_size = strlen(path) + 1;
-
-    if_not_malloc((*current)->path, malloc_size,
-        free(*current);
+    if(split_file_entry_path(path, &(*current)->dir, &(*current)->name) != 0) {
         *current = previous;
         return (1);
-    )
-    snprintf((*current)->path, malloc_size, "%s", path);
+    }
     (*current)->size = size + options->overload_size;
     (*current)->size = round_num((*current)->size, options->round_size);
 
@@ -553,7 +1446,7 @@ add_file_entry(struct file_entry **head, char *path, fsize_t size,
 
     /* display added filename */
     if(options->verbose >= OPT_VVERBOSE)
-        fprintf(stderr, "%s\n", (*current)->path);
+        fprintf(stderr, "%s\n", path);
 
     return (0);
 }
@@ -591,6 +1484,26 @@ fts_dirsfirst(const FTSENT * const *a, const FTSENT * const *b)
             return (0);
 }
 
+/* Reset size of directory at a given level, growing sizes array as needed
+   - returns 0 (success) or 1 (failure) */
+static int
+set_level_size(fsize_t **level_sizes, size_t *level_sizes_num, short level)
+{
+    assert(level_sizes != NULL);
+    assert(level_sizes_num != NULL);
+    assert(level >= 0);
+
+    if((size_t)level >= *level_sizes_num) {
+        size_t alloc_num = max(*level_sizes_num * 2, (size_t)level + 1);
+        if_not_realloc(*level_sizes, sizeof(fsize_t) * alloc_num,
+            return (1);
+        )
+        *level_sizes_num = alloc_num;
+    }
+    (*level_sizes)[level] = 0;
+    return (0);
+}
+
 /* Initialize a double-linked list of file_entries from a path
    - file_path may be a file or directory
    - if head is NULL, creates a new list ; if not, chains a new list to it
@@ -642,7 +1555,52 @@ init_file_entries(char *file_path, struct file_entry **head, fnum_t *count,
     unsigned char curdir_addme = 0;     /* current dir must be added */
     fsize_t curdir_size = 0;            /* current dir size */
 
+    /* recursive size of each directory being crawled, indexed by fts level.
+       Sizes are summed up bottom-up, in post-order */
+    fsize_t *level_sizes = NULL;
+    size_t level_sizes_num = 0;
+    short sizing_level = -1;            /* when >= 0, level of a directory
+                                           crawled only to compute its size */
+
     while((p = fts_read(ftsp)) != NULL) {
+        /* within a directory crawled only to compute its size (see option -d),
+           just sum up file sizes */
+        if((sizing_level >= 0) && (p->fts_level > sizing_level)) {
+            switch (p->fts_info) {
+                case FTS_ERR:
+                case FTS_DNR:
+                case FTS_NS:
+                    fprintf(stderr, "%s: %s\n", p->fts_path,
+                        strerror(p->fts_errno));
+                    continue;
+
+                case FTS_DC:
+                    fprintf(stderr, "%s: filesystem loop detected\n",
+                        p->fts_path);
+                    continue;
+
+                case FTS_D:
+                    if(set_level_size(&level_sizes, &level_sizes_num,
+                        p->fts_level) != 0) {
+                        free(level_sizes);
+                        fts_close(ftsp);
+                        return (1);
+                    }
+                    continue;
+
+                case FTS_DP:
+                    level_sizes[p->fts_level - 1] += level_sizes[p->fts_level];
+                    continue;
+
+                case FTS_F:
+                    level_sizes[p->fts_level - 1] += get_size(p->fts_statp);
+                    continue;
+
+                default:
+                    continue;
+            }
+        }
+
         switch (p->fts_info) {
             /* misc errors */
             case FTS_ERR:
@@ -656,6 +1614,10 @@ init_file_entries(char *file_path, struct file_entry **head, fnum_t *count,
             {
                 fprintf(stderr, "%s: %s\n", p->fts_path,
                     strerror(p->fts_errno));
+                /* if size was requested (option -d), add directory anyway
+                   (with a null size) by simulating FTS_DP */
+                if(sizing_level >= 0)
+                    goto end_directory;
                 /* if requested by the -zz option,
                    add directory anyway by simulating FTS_DP */
                 if(options->dirs_include >= OPT_DNREMPTY) {
@@ -682,6 +1644,12 @@ init_file_entries(char *file_path, struct file_entry **head, fnum_t *count,
 
             case FTS_DP:
             {
+end_directory:
+                /* add directory size to its parent's one */
+                if(p->fts_level > 0)
+                    level_sizes[p->fts_level - 1] += level_sizes[p->fts_level];
+                sizing_level = -1;
+
 add_directory:
                 /* if dirs_only mode activated or
                    leaf_dirs mode activated and current directory is a leaf or
@@ -693,8 +1661,8 @@ add_directory:
 
                 /* if current directory has not been added by previous rules
                    but we request all directory entries, we fake an empty dir
-                   to avoid a call to get_size() below as we want it with a
-                   size of 0 */
+                   to avoid using its recursive size below as we want it with
+                   a size of 0 */
                 if((!curdir_addme) && (options->dirs_include >= OPT_ALLDIRS)) {
                     curdir_addme = 1;
                     curdir_empty = 1;
@@ -717,6 +1685,7 @@ add_directory:
                        added */
                     size_t malloc_size = p->fts_pathlen + 1 + 1;
                     if_not_malloc(curdir_entry_path, malloc_size,
+                        free(level_sizes);
                         fts_close(ftsp);
                         return (1);
                     )
@@ -741,8 +1710,7 @@ add_directory:
                     else if(curdir_empty)
                         curdir_size = 0;
                     else if(options->dirs_only == OPT_NODIRSONLY)
-                        curdir_size =
-                            get_size(p->fts_accpath, p->fts_statp, options);
+                        curdir_size = level_sizes[p->fts_level];
                     /* else leave curdir_size untouched */
 
                     /* add or display it */
@@ -753,6 +1721,7 @@ add_directory:
                         fprintf(stderr, "%s(): cannot add file entry\n",
                             __func__);
                         free(curdir_entry_path);
+                        free(level_sizes);
                         fts_close(ftsp);
                         return (1);
                     }
@@ -775,6 +1744,12 @@ reset_directory:
                 file_as_argument = 0; /* argument was not a file */
                 curdir_empty = 1; /* enter directory, mark it as empty */
                 curdir_dirsfound = 0; /* no dirs found yet */
+                if(set_level_size(&level_sizes, &level_sizes_num,
+                    p->fts_level) != 0) {
+                    free(level_sizes);
+                    fts_close(ftsp);
+                    return (1);
+                }
 
                 /* check for name validity regarding exclude options */
                 if(!valid_filename(p->fts_name, options, 0)) {
@@ -785,15 +1760,15 @@ reset_directory:
                     continue;
                 }
 
-                /* if dir_depth requested and reached,
-                   skip descendants but add directory entry (in post order) */
+                /* if dir_depth requested and reached, do not add descendants
+                   but crawl them to compute directory size and add directory
+                   entry (in post order) */
                 if((options->dir_depth != OPT_NODIRDEPTH) &&
                     (p->fts_level >= options->dir_depth)) {
-                    fts_set(ftsp, p, FTS_SKIP);
+                    sizing_level = p->fts_level;
                     curdir_addme = 1;
-                    /* as we have not crawled into this directory yet,
-                       remove the empty flag to allow a call to get_size() in
-                       FTS_DP */
+                    /* remove the empty flag to get directory size computed
+                       in FTS_DP */
                     curdir_empty = 0;
                 }
                 continue;
@@ -807,11 +1782,12 @@ reset_directory:
                    size. We must have visited all directories first for that
                    total to be right ; this is achieved by using a compar()
                    function with fts_open() */
-                fsize_t curfile_size =
-                    get_size(p->fts_accpath, p->fts_statp, options);
+                fsize_t curfile_size = get_size(p->fts_statp);
 
                 curdir_empty = 0; /* mark current dir as non empty */
                 curdir_size += curfile_size;
+                if(p->fts_level > 0)
+                    level_sizes[p->fts_level - 1] += curfile_size;
 
                 /* skip file entry when in dirs_only mode (option -E) or
                    in leaf_dirs mode (option -D) and no directory has been
@@ -837,6 +1813,7 @@ reset_directory:
                     (*count)++;
                 else {
                     fprintf(stderr, "%s(): cannot add file entry\n", __func__);
+                    free(level_sizes);
                     fts_close(ftsp);
                     return (1);
                 }
@@ -845,6 +1822,8 @@ reset_directory:
         }
     }
 
+    free(level_sizes);
+
     if(errno != 0) {
         fprintf(stderr, "%s: fts_read()\n", file_path);
         fts_close(ftsp);
@@ -857,56 +1836,89 @@ reset_directory:
     return (0);
 }
 
-/* Un-initialize a double-linked list of file_entries */
+/* Un-initialize file_entries: release every file entry allocated so far
+   (whatever list it belongs to) */
 void
-uninit_file_entries(struct file_entry *head, struct program_options *options)
+uninit_file_entries(struct program_options *options)
 {
     assert(options != NULL);
 
-    /* be sure to start from last file entry */
-    fastfw_list(head);
-
-    struct file_entry *current = head;
-    struct file_entry *prev = NULL;
-
-    while(current != NULL) {
-        if(current->path != NULL) {
-            free(current->path);
-        }
-        prev = current->prevp;
-        free(current);
-        current = prev;
-    }
+    /* release every file entry and path at once */
+    uninit_fe_storage();
 
     /* live mode */
     if(options->live_mode == OPT_LIVEMODE) {
-        /* display added partition */
-        if((options->verbose >= OPT_VERBOSE) &&
-            (live_status.partition_num_files > 0))
-            fprintf(stderr, "Filled part #%d: size = %lld, %lld file(s)\n",
-                live_status.partition_index, live_status.partition_size,
-                live_status.partition_num_files);
-
-        /* flush buffer or close last file if necessary */
-        if(options->out_filename == NULL)
-            fflush(stdout);
-        else if(live_status.filename != NULL)
-            close(live_status.fd);
-
-        /* execute last post-partition hook */
-        if((options->post_part_hook != NULL) &&
-            (live_status.partition_num_files > 0)) {
-            if(fpart_hook(options->post_part_hook, options,
-                live_status.filename, &live_status.partition_index,
-                &live_status.partition_size,
-                &live_status.partition_num_files) != 0)
-                live_status.exit_summary = 1;
+        /* drop entries still held back (on error) */
+        while(live_pending.first < live_pending.end) {
+            if(live_pending.entries[live_pending.first].path != NULL)
+                free(live_pending.entries[live_pending.first].path);
+            live_pending.first++;
         }
+        live_pending.num_entries = 0;
+        if(live_pending.entries != NULL) {
+            free(live_pending.entries);
+            live_pending.entries = NULL;
+        }
+
+        /* flush and close partition files (options -n and -o) */
+        if(live_status.files.files != NULL)
+            uninit_out_files(&live_status.files);
+
+        /* close open partitions, oldest first */
+        unsigned int i;
+        for(i = 0 ; i < live_status.num_parts ; i++) {
+            struct live_partition *part = &live_status.parts[i];
+
+            /* display added partition */
+            if(options->verbose >= OPT_VERBOSE)
+                fprintf(stderr, "Filled part #%d: size = %lld, %lld file(s)\n",
+                    part->partition_index, part->partition_size,
+                    part->partition_num_files);
+
+            /* flush buffer and close file */
+            out_buffer_flush(live_partition_buffer(part, options));
+            if(part->fd >= 0) {
+                close(part->fd);
+                part->fd = -1;
+            }
+
+            /* execute last post-partition hooks */
+            if(options->post_part_hook != NULL) {
+                if(fpart_hook(options->post_part_hook, options,
+                    part->filename, &part->partition_index,
+                    &part->partition_size,
+                    &part->partition_num_files) != 0)
+                    live_status.exit_summary = 1;
+            }
 
-        if(live_status.filename != NULL) {
-            free(live_status.filename);
-            live_status.filename = NULL;
+            if(part->filename != NULL) {
+                free(part->filename);
+                part->filename = NULL;
+            }
         }
+        live_status.num_parts = 0;
+        if(live_status.heap != NULL) {
+            free(live_status.heap);
+            live_status.heap = NULL;
+        }
+        live_status.num_heap = 0;
+
+        /* release write buffers */
+        if(live_status.parts != NULL) {
+            for(i = 0 ; i < live_max_open_parts(options) ; i++)
+                uninit_out_buffer(&live_status.parts[i].buffer);
+            free(live_status.parts);
+            live_status.parts = NULL;
+        }
+        uninit_out_buffer(&live_status.buffer);
+
+        /* wait for asynchronous hooks */
+        wait_hooks(options, 0);
+        if(live_status.hook_pids != NULL) {
+            free(live_status.hook_pids);
+            live_status.hook_pids = NULL;
+        }
+        uninit_hook_env();
 
         /* print hooks' exit codes summary */
         if((options->verbose >= OPT_VERBOSE) && (live_status.exit_summary != 0))
@@ -932,86 +1944,38 @@ print_file_entries(struct file_entry *head, pnum_t num_parts,
     /* no template provided, just print to stdout and return */
     if(out_template == NULL) {
         while(head != NULL) {
+            const char *path = file_entry_path(head);
+            if(path == NULL)
+                return (1);
             fprintf(stdout, "%d (%lld): %s\n", head->partition_index,
-                head->size, head->path);
+                head->size, path);
             head = head->nextp;
         }
         return (0);
     }
 
-    /* a template has been provided; to avoid opening too many files,
-       open chunks of FDs and do as many passes as necessary */
-    struct file_entry *start = head;
-    pnum_t current_chunk = 0;           /* current chunk */
-    pnum_t current_file_entry = 0;      /* current file entry within chunk */
-
-    assert(PRINT_FE_CHUNKS > 0);
-
-    while(((current_chunk * PRINT_FE_CHUNKS) + current_file_entry) <
-        num_parts) {
-        int fd[PRINT_FE_CHUNKS]; /* our <files per chunk> file descriptors */
-
-        /* open as necessary file descriptors as needed
-           to print num_part partitions */
-        while((current_file_entry < PRINT_FE_CHUNKS) &&
-              (((current_chunk * PRINT_FE_CHUNKS) + current_file_entry) < num_parts)) {
-            /* compute out_filename  "out_template.i\0" */
-            char *out_filename = NULL;
-            size_t malloc_size = strlen(out_template) + 1 + get_num_digits
-                ((current_chunk * PRINT_FE_CHUNKS) + current_file_entry) + 1;
-            if_not_malloc(out_filename, malloc_size,
-                /* close all open descriptors and return */
-                pnum_t i;
-                for(i = 0; i < current_file_entry; i++)
-                     close(fd[i]);
-                return (1);
-            )
-            snprintf(out_filename, malloc_size, "%s.%d", out_template,
-                (current_chunk * PRINT_FE_CHUNKS) + current_file_entry);
-
-            if((fd[current_file_entry] =
-                open(out_filename, O_WRONLY|O_CREAT|O_TRUNC, 0660)) < 0) {
-                fprintf(stderr, "%s: %s\n", out_filename, strerror(errno));
-                free(out_filename);
-                /* close all open descriptors and return */
-                pnum_t i;
-                for(i = 0; i < current_file_entry; i++)
-                     close(fd[i]);
-                return (1);
-            }
-            free(out_filename);
-            current_file_entry++;
-        }
-
-        while(head != NULL) {
-            if((head->partition_index >= (current_chunk * PRINT_FE_CHUNKS)) &&
-               (head->partition_index < ((current_chunk + 1) * PRINT_FE_CHUNKS))) {
-                size_t to_write = strlen(head->path);
-                if((write(fd[head->partition_index % PRINT_FE_CHUNKS], head->path, to_write) != (ssize_t)to_write) ||
-                    (write(fd[head->partition_index % PRINT_FE_CHUNKS], ln_term, 1) != 1)) {
-                    fprintf(stderr, "%s\n", strerror(errno));
-                    /* close all open descriptors */
-                    pnum_t i;
-                    for(i = 0; (i < PRINT_FE_CHUNKS) && (((current_chunk * PRINT_FE_CHUNKS) + i) < num_parts); i++)
-                        close(fd[i]);
-                    return (1);
-                }
-            }
-            head = head->nextp;
-        }
-        /* come back to first entry */
-        head = start;
+    /* a template has been provided, write all partitions in a single pass */
+    struct out_files files;
+    int error = 0;
 
-        /* close file descriptors */
-        pnum_t i;
-        for(i = 0; (i < PRINT_FE_CHUNKS) && (((current_chunk * PRINT_FE_CHUNKS) + i) < num_parts); i++)
-            close(fd[i]);
+    if(init_out_files(&files, out_template, num_parts,
+        OUTPUT_MAX_BUFFER_SIZE) != 0)
+        return (1);
 
-        current_file_entry = 0;
-        current_chunk++;
+    while((head != NULL) && (!error)) {
+        const char *path = file_entry_path(head);
+        if((path == NULL) ||
+            (out_files_write(&files, head->partition_index, path,
+            strlen(path)) != 0) ||
+            (out_files_write(&files, head->partition_index, ln_term, 1) != 0))
+            error = 1;
+        head = head->nextp;
     }
 
-    return (0);
+    if(uninit_out_files(&files) != 0)
+        error = 1;
+
+    return (error);
 }
 
 /***************************************************
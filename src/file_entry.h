@@ -32,15 +32,26 @@
 
 #include <sys/types.h>
 
-#if !defined(PRINT_FE_CHUNKS)
-#define PRINT_FE_CHUNKS 32          /* files per chunk when flushing
-                                       partitions to disk */
+#if !defined(FE_ARENA_ENTRIES)
+#define FE_ARENA_ENTRIES 32768      /* file entries allocated at once */
 #endif
 
+/* A directory node ; file entries' paths are stored as a leaf name
+   attached to a tree of directories to avoid duplicating common prefixes */
+struct dir_node;
+struct dir_node {
+    char *name;                     /* path component, including its
+                                       trailing slash(es) */
+    size_t len;                     /* full path length of this directory */
+
+    struct dir_node* parentp;       /* parent directory */
+};
+
 /* A file entry */
 struct file_entry;
 struct file_entry {
-    char *path;                     /* file name */
+    struct dir_node *dir;           /* parent directory (may be NULL) */
+    char *name;                     /* file name, within dir */
     fsize_t size;                   /* size in bytes */
     pnum_t partition_index;         /* assigned partition index */
 
@@ -55,12 +66,15 @@ int handle_file_entry(struct file_entry **head, char *path, fsize_t size,
     struct program_options *options);
 int live_print_file_entry(char *path, fsize_t size,
     struct program_options *options);
+int live_flush_file_entries(struct program_options *options);
 int add_file_entry(struct file_entry **head, char *path, fsize_t size,
     struct program_options *options);
 int init_file_entries(char *file_path, struct file_entry **head, fnum_t *count,
     struct program_options *options);
-void uninit_file_entries(struct file_entry *head,
-    struct program_options *options);
+void uninit_file_entries(struct program_options *options);
+size_t file_entries_memory(void);
+void print_file_entries_memory(void);
+const char *file_entry_path(const struct file_entry *fe);
 int print_file_entries(struct file_entry *head, pnum_t num_parts,
     struct program_options *options);
 void init_file_entry_p(struct file_entry **file_entry_p, fnum_t num_entries,
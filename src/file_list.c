@@ -0,0 +1,262 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "options.h"
+#include "output.h"
+#include "file_entry.h"
+#include "file_list.h"
+
+/* fprintf(3) */
+#include <stdio.h>
+
+/* malloc(3) */
+#include <stdlib.h>
+
+/* strerror(3), strlen(3), memcpy(3), memcmp(3), memset(3) */
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* open(2) */
+#include <fcntl.h>
+
+/* close(2), pread(2) */
+#include <unistd.h>
+
+/* fstat(2) */
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* mmap(2), munmap(2) */
+#include <sys/mman.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/***********************************
+ Binary file list functions
+ ***********************************/
+
+/* List being written (option -O) */
+static struct {
+    struct out_buffer buffer;
+} file_list = {
+    { -1, NULL, 0, 0 }
+};
+
+/* Write a (size, path) record
+   - returns 0 (success) or 1 (failure) */
+int
+file_list_write_record(struct out_buffer *buffer, fsize_t size,
+    const char *path, size_t path_len)
+{
+    assert(buffer != NULL);
+    assert(path != NULL);
+
+    uint32_t len = (uint32_t)path_len;
+
+    if(path_len > UINT32_MAX) {
+        fprintf(stderr, "%s(): path too long\n", __func__);
+        return (1);
+    }
+    if((out_buffer_write(buffer, (char *)&size, sizeof(size)) != 0) ||
+        (out_buffer_write(buffer, (char *)&len, sizeof(len)) != 0) ||
+        (out_buffer_write(buffer, path, path_len) != 0))
+        return (1);
+    return (0);
+}
+
+/* Create a binary file list and write its header
+   - returns 0 (success) or 1 (failure) */
+int
+init_file_list_output(const char *filename)
+{
+    assert(filename != NULL);
+    assert(file_list.buffer.fd < 0);
+
+    struct file_list_header header;
+    int fd = -1;
+
+    if((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0660)) < 0) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        return (1);
+    }
+    init_out_buffer(&file_list.buffer, fd, OUTPUT_MAX_BUFFER_SIZE);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_LIST_MAGIC, sizeof(header.magic));
+    header.version = FILE_LIST_VERSION;
+    header.size_len = sizeof(fsize_t);
+    header.byte_order = FILE_LIST_BYTE_ORDER;
+    return (out_buffer_write(&file_list.buffer, (char *)&header,
+        sizeof(header)));
+}
+
+/* Add an entry to the binary file list being written
+   - returns 0 (success) or 1 (failure) */
+int
+file_list_write(const char *path, fsize_t size)
+{
+    assert(path != NULL);
+    assert(file_list.buffer.fd >= 0);
+
+    return (file_list_write_record(&file_list.buffer, size, path,
+        strlen(path)));
+}
+
+/* Flush and close the binary file list being written
+   - returns 0 (success) or 1 (failure) */
+int
+uninit_file_list_output(void)
+{
+    int error = 0;
+
+    if(file_list.buffer.fd < 0)
+        return (0);
+
+    if(out_buffer_flush(&file_list.buffer) != 0)
+        error = 1;
+    if(close(file_list.buffer.fd) != 0)
+        error = 1;
+    uninit_out_buffer(&file_list.buffer);
+    file_list.buffer.fd = -1;
+    return (error);
+}
+
+/* Check if a file descriptor refers to a binary file list ; only regular
+   files are checked (as they can be memory-mapped), without changing
+   file offset
+   - returns 1 if fd refers to a binary file list, else 0 */
+int
+is_file_list(int fd)
+{
+    struct file_list_header header;
+    struct stat st;
+
+    if((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)) ||
+        (st.st_size < (off_t)sizeof(header)))
+        return (0);
+    if(pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+        return (0);
+    return (memcmp(header.magic, FILE_LIST_MAGIC, sizeof(header.magic)) == 0);
+}
+
+/* Initialize a double-linked list of file_entries from a binary file list,
+   read through mmap(2). Entries are added as arbitrary values (option -a),
+   without examining the filesystem
+   - returns != 0 if a critical error occurred
+   - updates count with the number of entries added */
+int
+init_file_entries_from_list(int fd, const char *filename,
+    struct file_entry **head, fnum_t *count, struct program_options *options)
+{
+    assert(filename != NULL);
+    assert(head != NULL);
+    assert(count != NULL);
+    assert(options != NULL);
+
+    const struct file_list_header *header = NULL;
+    const char *map = NULL;
+    size_t map_size = 0;
+    size_t offset = sizeof(struct file_list_header);
+    char *path = NULL;
+    size_t path_size = 0;
+    struct stat st;
+    int error = 0;
+
+    if(fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        return (1);
+    }
+    map_size = (size_t)st.st_size;
+    if((map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+        MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        return (1);
+    }
+#if defined(MADV_SEQUENTIAL)
+    madvise((void *)map, map_size, MADV_SEQUENTIAL);
+#endif
+
+    header = (const struct file_list_header *)map;
+    if((map_size < sizeof(struct file_list_header)) ||
+        (memcmp(header->magic, FILE_LIST_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->version != FILE_LIST_VERSION) ||
+        (header->size_len != sizeof(fsize_t)) ||
+        (header->byte_order != FILE_LIST_BYTE_ORDER)) {
+        fprintf(stderr, "%s: unsupported file list\n", filename);
+        munmap((void *)map, map_size);
+        return (1);
+    }
+
+    while((offset < map_size) && (!error)) {
+        fsize_t size = 0;
+        uint32_t len = 0;
+
+        if(map_size - offset < FILE_LIST_RECORD_HEADER_SIZE) {
+            fprintf(stderr, "%s: truncated file list\n", filename);
+            error = 1;
+            break;
+        }
+        memcpy(&size, &map[offset], sizeof(size));
+        memcpy(&len, &map[offset + sizeof(size)], sizeof(len));
+        offset += FILE_LIST_RECORD_HEADER_SIZE;
+        if(map_size - offset < len) {
+            fprintf(stderr, "%s: truncated file list\n", filename);
+            error = 1;
+            break;
+        }
+
+        /* paths are not '\0'-terminated within list */
+        if((size_t)len + 1 > path_size) {
+            size_t new_size = max((size_t)len + 1, path_size * 2);
+            if_not_realloc(path, new_size,
+                error = 1;
+                break;
+            )
+            path_size = new_size;
+        }
+        memcpy(path, &map[offset], len);
+        path[len] = '\0';
+        offset += len;
+
+        if(handle_file_entry(head, path, size, options) == 0)
+            (*count)++;
+        else {
+            fprintf(stderr, "%s(): cannot add file entry\n", __func__);
+            error = 1;
+        }
+    }
+
+    if(path != NULL)
+        free(path);
+    munmap((void *)map, map_size);
+    return (error);
+}
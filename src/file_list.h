@@ -0,0 +1,70 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _FILE_LIST_H
+#define _FILE_LIST_H
+
+#include "types.h"
+#include "options.h"
+#include "output.h"
+#include "file_entry.h"
+
+/* uint32_t, uint64_t */
+#include <stdint.h>
+
+/* size_t */
+#include <stddef.h>
+
+#define FILE_LIST_MAGIC         "FPARTLST"
+#define FILE_LIST_VERSION       1
+#define FILE_LIST_BYTE_ORDER    0x0102030405060708ULL
+
+/* Binary file list header. A binary file list is made of a header followed
+   by records:
+     fsize_t size | uint32_t path length | path (without ending '\0')
+   Records are neither aligned nor counted, the list ends with the file.
+   The same record format is used for external sort runs (see extsort.c).
+   Lists are not portable across architectures */
+struct file_list_header {
+    char magic[8];                  /* FILE_LIST_MAGIC */
+    uint32_t version;               /* FILE_LIST_VERSION */
+    uint32_t size_len;              /* sizeof(fsize_t) */
+    uint64_t byte_order;            /* FILE_LIST_BYTE_ORDER */
+};
+
+#define FILE_LIST_RECORD_HEADER_SIZE (sizeof(fsize_t) + sizeof(uint32_t))
+
+int file_list_write_record(struct out_buffer *buffer, fsize_t size,
+    const char *path, size_t path_len);
+int init_file_list_output(const char *filename);
+int file_list_write(const char *path, fsize_t size);
+int uninit_file_list_output(void);
+int is_file_list(int fd);
+int init_file_entries_from_list(int fd, const char *filename,
+    struct file_entry **head, fnum_t *count, struct program_options *options);
+
+#endif /* _FILE_LIST_H */
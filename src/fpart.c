@@ -30,7 +30,13 @@
 #include "options.h"
 #include "partition.h"
 #include "file_entry.h"
+#include "crawler.h"
+#include "crawl_index.h"
+#include "file_list.h"
+#include "line_reader.h"
 #include "dispatch.h"
+#include "extsort.h"
+#include "checkpoint.h"
 
 /* NULL, exit(3) */
 #include <stdlib.h>
@@ -93,16 +99,31 @@ usage(void)
     fprintf(stderr, "  -n\tpack files into <num> partitions\n");
     fprintf(stderr, "  -f\tlimit partitions to <files> files or directories\n");
     fprintf(stderr, "  -s\tlimit partitions to <size> bytes\n");
+    fprintf(stderr, "  -S\tpack biggest files first (with -f or -s, "
+        "first-fit decreasing)\n");
+    fprintf(stderr, "  -M\tlimit memory used to store file entries to "
+        "<size> bytes,\n\tusing temporary files beyond (with -n only)\n");
+    fprintf(stderr, "  -T\tstore temporary files in <dir> "
+        "(default: $TMPDIR or /tmp)\n");
+    fprintf(stderr, "  -K\tdispatch and write file entries every <num> "
+        "files\n\t(checkpoint, with -n and -o only)\n");
+    fprintf(stderr, "  -c\tbalance partitions counting each file as <num> "
+        "more bytes\n\t(with -n only, default: 0)\n");
+    fprintf(stderr, "  -R\trefine partitions during up to <ms> milliseconds "
+        "after\n\tdispatching files (with -n only)\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Input control:\n");
     fprintf(stderr, "  -i\tread file list from <infile> "
         "(stdin if '-' is specified)\n");
     fprintf(stderr, "  -a\tinput contains arbitrary values "
-        "(do not crawl filesystem)\n");
+        "(do not crawl filesystem),\n\tbinary file lists (see -O) are "
+        "detected and read as such\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Output control:\n");
     fprintf(stderr, "  -o\toutput partitions to <outfile> template "
         "(stdout if '-' is specified)\n");
+    fprintf(stderr, "  -O\tsave file entries found to <file>, as a binary "
+        "file list (see -i)\n");
     fprintf(stderr, "  -0\tend filenames with a null (\\0) character when "
         "using option -o\n");
     fprintf(stderr, "  -e\tadd ending slash to directories\n");
@@ -112,6 +133,10 @@ usage(void)
     fprintf(stderr, "Filesystem crawling control:\n");
     fprintf(stderr, "  -l\tfollow symbolic links\n");
     fprintf(stderr, "  -b\tdo not cross filesystem boundaries\n");
+    fprintf(stderr, "  -t\tcrawl filesystem using <num> threads "
+        "(default: 1)\n");
+    fprintf(stderr, "  -I\tmaintain an index of crawled files in <file> and "
+        "only pack files\n\tthat changed since previous run\n");
     fprintf(stderr, "  -y\tinclude files matching <pattern> only (may be "
         "specified more than once)\n");
 #if defined(_HAS_FNM_CASEFOLD)
@@ -141,6 +166,14 @@ usage(void)
         "start\n");
     fprintf(stderr, "  -W\tpost-partition hook: execute <cmd> at partition "
         "end\n");
+    fprintf(stderr, "  -H\trun up to <num> post-partition hooks in the "
+        "background\n\t(default: 0, wait for each hook)\n");
+    fprintf(stderr, "  -B\tbuffer partitions' output using <size> bytes "
+        "(default: %d, 0 disables)\n", DFLT_OPT_LIVE_BUFFER_SIZE);
+    fprintf(stderr, "  -A\thold up to <num> entries back to fill partitions "
+        "up to\n\ttheir size limit (with -s only)\n");
+    fprintf(stderr, "  -P\tkeep up to <num> partitions open, adding each file "
+        "to the\n\tfullest one it fits in (with -s only, default: 1)\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "Size handling:\n");
     fprintf(stderr, "  -p\tpreload each partition with <num> bytes\n");
@@ -155,6 +188,40 @@ usage(void)
     return;
 }
 
+/* Paths waiting to be crawled concurrently (options -t and -I) */
+static char **crawl_paths = NULL;
+static unsigned int num_crawl_paths = 0;
+
+/* Crawl paths waiting to be crawled, using the parallel crawler
+   - returns 0 (success) or 1 (failure) */
+static int
+crawl_pending_paths(fnum_t *totalfiles, struct file_entry **head,
+    struct program_options *options)
+{
+    assert(totalfiles != NULL);
+    assert(head != NULL);
+    assert(options != NULL);
+
+    int error = 0;
+
+    if(num_crawl_paths == 0)
+        return (0);
+
+#if defined(DEBUG)
+    fprintf(stderr, "%s(): examining %u path(s)\n", __func__,
+        num_crawl_paths);
+#endif
+    if(parallel_init_file_entries(crawl_paths, num_crawl_paths, head,
+        totalfiles, options) != 0) {
+        fprintf(stderr, "%s(): cannot initialize file entries\n", __func__);
+        error = 1;
+    }
+
+    /* cleanup */
+    str_cleanup(&crawl_paths, &num_crawl_paths);
+    return (error);
+}
+
 /* Handle one argument (either a path to crawl or an arbitrary
    value) and update file entries (head)
    - returns != 0 if a critical error occurred
@@ -173,24 +240,18 @@ handle_argument(char *argument, fnum_t *totalfiles, struct file_entry **head,
     /* handle arbitrary values */
         fsize_t input_size = 0;
         char *input_path = NULL;
-        if_not_malloc(input_path, strlen(argument) + 1,
-            return (1);
-        )
 
-        if(sscanf(argument, "%lld %[^\n]", &input_size, input_path) == 2) {
+        /* parsed in place, input_path points within argument */
+        if(parse_arbitrary_value(argument, &input_size, &input_path) == 0) {
             if(handle_file_entry(head, input_path, input_size, options) == 0)
                 (*totalfiles)++;
             else {
                 fprintf(stderr, "%s(): cannot add file entry\n", __func__);
-                free(input_path);
                 return (1);
             }
         }
         else
             fprintf(stderr, "error parsing input values: %s\n", argument);
-
-        /* cleanup */
-        free(input_path);
     }
     else {
     /* handle paths, must examine filesystem */
@@ -210,8 +271,19 @@ handle_argument(char *argument, fnum_t *totalfiles, struct file_entry **head,
             input_path_len--;
         }
 
+        /* queue path, to crawl it concurrently with next ones */
+        if((input_path[0] != '\0') &&
+            ((options->num_threads > 1) ||
+            (options->index_filename != NULL))) {
+            if((str_push(&crawl_paths, &num_crawl_paths, input_path) != 0) ||
+                ((num_crawl_paths >= CRAWL_BATCH_PATHS) &&
+                (crawl_pending_paths(totalfiles, head, options) != 0))) {
+                free(input_path);
+                return (1);
+            }
+        }
         /* crawl path */
-        if(input_path[0] != '\0') {
+        else if(input_path[0] != '\0') {
 #if defined(DEBUG)
             fprintf(stderr, "init_file_entries(): examining %s\n",
                 input_path);
@@ -256,9 +328,9 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
     int ch;
     while((ch = getopt(*argcp, *argvp,
 #if defined(_HAS_FNM_CASEFOLD)
-        "?hVn:f:s:i:ao:0evlby:Y:x:X:zd:DELw:W:p:q:r:"
+        "?hVn:f:s:SM:T:K:c:R:i:ao:O:0evlbt:I:y:Y:x:X:zd:DELw:W:H:B:A:P:p:q:r:"
 #else
-        "?hVn:f:s:i:ao:0evlby:x:zd:DELw:W:p:q:r:"
+        "?hVn:f:s:SM:T:K:c:R:i:ao:O:0evlbt:I:y:x:zd:DELw:W:H:B:A:P:p:q:r:"
 #endif
         )) != -1) {
         switch(ch) {
@@ -301,6 +373,9 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
                 options->max_size = (fsize_t)max_size;
                 break;
             }
+            case 'S':
+                options->sort_by_size = OPT_SORTBYSIZE;
+                break;
             case 'i':
             {
                 /* check for empty argument */
@@ -320,6 +395,82 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
             case 'a':
                 options->arbitrary_values = OPT_ARBITRARYVALUES;
                 break;
+            case 'M':
+            {
+                char *endptr = NULL;
+                long long mem_limit = strtoll(optarg, &endptr, 10);
+                /* refuse values <= 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (mem_limit <= 0)) {
+                    fprintf(stderr,
+                        "Option -M requires a value greater than 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->mem_limit = (size_t)mem_limit;
+                break;
+            }
+            case 'T':
+            {
+                /* check for empty argument */
+                size_t malloc_size = strlen(optarg) + 1;
+                if(malloc_size <= 1)
+                    break;
+                /* replace previous dir if '-T' specified multiple times */
+                if(options->tmp_dir != NULL)
+                    free(options->tmp_dir);
+                if_not_malloc(options->tmp_dir, malloc_size,
+                    return (FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                )
+                snprintf(options->tmp_dir, malloc_size, "%s", optarg);
+                break;
+            }
+            case 'K':
+            {
+                char *endptr = NULL;
+                long long checkpoint_entries = strtoll(optarg, &endptr, 10);
+                /* refuse values <= 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (checkpoint_entries <= 0)) {
+                    fprintf(stderr,
+                        "Option -K requires a value greater than 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->checkpoint_entries = (fnum_t)checkpoint_entries;
+                break;
+            }
+            case 'c':
+            {
+                char *endptr = NULL;
+                long long file_cost = strtoll(optarg, &endptr, 10);
+                /* refuse values < 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (file_cost < 0)) {
+                    fprintf(stderr,
+                        "Option -c requires a value greater than or "
+                        "equal to 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->file_cost = (fsize_t)file_cost;
+                break;
+            }
+            case 'R':
+            {
+                char *endptr = NULL;
+                long refine_time = strtol(optarg, &endptr, 10);
+                /* refuse values <= 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (refine_time <= 0)) {
+                    fprintf(stderr,
+                        "Option -R requires a value greater than 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->refine_time = (unsigned int)refine_time;
+                break;
+            }
             case 'o':
             {
                 /* check for empty argument */
@@ -356,6 +507,51 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
             case 'b':
                 options->cross_fs_boundaries = OPT_NOCROSSFSBOUNDARIES;
                 break;
+            case 't':
+            {
+                char *endptr = NULL;
+                long num_threads = strtol(optarg, &endptr, 10);
+                /* refuse values <= 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (num_threads <= 0)) {
+                    fprintf(stderr,
+                        "Option -t requires a value greater than 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->num_threads = (unsigned int)num_threads;
+                break;
+            }
+            case 'I':
+            {
+                /* check for empty argument */
+                size_t malloc_size = strlen(optarg) + 1;
+                if(malloc_size <= 1)
+                    break;
+                /* replace previous index if '-I' specified multiple times */
+                if(options->index_filename != NULL)
+                    free(options->index_filename);
+                if_not_malloc(options->index_filename, malloc_size,
+                    return (FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                )
+                snprintf(options->index_filename, malloc_size, "%s", optarg);
+                break;
+            }
+            case 'O':
+            {
+                /* check for empty argument */
+                size_t malloc_size = strlen(optarg) + 1;
+                if(malloc_size <= 1)
+                    break;
+                /* replace previous list if '-O' specified multiple times */
+                if(options->list_filename != NULL)
+                    free(options->list_filename);
+                if_not_malloc(options->list_filename, malloc_size,
+                    return (FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                )
+                snprintf(options->list_filename, malloc_size, "%s", optarg);
+                break;
+            }
             case 'y':
             case 'Y':   /* needs _HAS_FNM_CASEFOLD */
             case 'x':
@@ -443,6 +639,68 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
                 snprintf(options->post_part_hook, malloc_size, "%s", optarg);
                 break;
             }
+            case 'H':
+            {
+                char *endptr = NULL;
+                long async_hooks = strtol(optarg, &endptr, 10);
+                /* refuse values < 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (async_hooks < 0)) {
+                    fprintf(stderr,
+                        "Option -H requires a value greater than or "
+                        "equal to 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->async_hooks = (unsigned int)async_hooks;
+                break;
+            }
+            case 'B':
+            {
+                char *endptr = NULL;
+                long long live_buffer_size = strtoll(optarg, &endptr, 10);
+                /* refuse values < 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (live_buffer_size < 0)) {
+                    fprintf(stderr,
+                        "Option -B requires a value greater than or "
+                        "equal to 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->live_buffer_size = (size_t)live_buffer_size;
+                break;
+            }
+            case 'A':
+            {
+                char *endptr = NULL;
+                long live_lookahead = strtol(optarg, &endptr, 10);
+                /* refuse values <= 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (live_lookahead <= 0)) {
+                    fprintf(stderr,
+                        "Option -A requires a value greater than 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->live_lookahead = (unsigned int)live_lookahead;
+                break;
+            }
+            case 'P':
+            {
+                char *endptr = NULL;
+                long live_open_parts = strtol(optarg, &endptr, 10);
+                /* refuse values <= 0 and partially-converted arguments */
+                if((endptr == optarg) || (*endptr != '\0') ||
+                    (live_open_parts <= 0)) {
+                    fprintf(stderr,
+                        "Option -P requires a value greater than 0.\n");
+                    return (FPART_OPTS_USAGE |
+                        FPART_OPTS_NOK | FPART_OPTS_EXIT);
+                }
+                options->live_open_parts = (unsigned int)live_open_parts;
+                break;
+            }
             case 'p':
             {
                 char *endptr = NULL;
@@ -503,10 +761,19 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
 
     if((options->num_parts != DFLT_OPT_NUM_PARTS) &&
         ((options->max_entries != DFLT_OPT_MAX_ENTRIES) ||
-                    (options->max_size != DFLT_OPT_MAX_SIZE) ||
-                    (options->live_mode != DFLT_OPT_LIVEMODE))) {
+                    (options->max_size != DFLT_OPT_MAX_SIZE))) {
         fprintf(stderr,
-            "Option -n is incompatible with options -f, -s and -L.\n");
+            "Option -n is incompatible with options -f and -s.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->sort_by_size != DFLT_OPT_SORTBYSIZE) &&
+        (((options->max_entries == DFLT_OPT_MAX_ENTRIES) &&
+        (options->max_size == DFLT_OPT_MAX_SIZE)) ||
+        (options->live_mode != DFLT_OPT_LIVEMODE))) {
+        fprintf(stderr,
+            "Option -S can only be used with options -f or -s and is "
+            "incompatible with option -L.\n");
         return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
     }
 
@@ -514,6 +781,8 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
         if((options->add_slash != DFLT_OPT_ADDSLASH) ||
             (options->follow_symbolic_links != DFLT_OPT_FOLLOWSYMLINKS) ||
             (options->cross_fs_boundaries != DFLT_OPT_CROSSFSBOUNDARIES) ||
+            (options->num_threads != DFLT_OPT_NUM_THREADS) ||
+            (options->index_filename != NULL) ||
             (options->include_files != NULL) ||
             (options->include_files_ci != NULL) ||
             (options->exclude_files != NULL) ||
@@ -557,6 +826,115 @@ handle_options(struct program_options *options, int *argcp, char ***argvp)
         return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
     }
 
+    if((options->post_part_hook == NULL) &&
+        (options->async_hooks != DFLT_OPT_ASYNC_HOOKS)) {
+        fprintf(stderr,
+            "Option -H can only be used with option -W.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->live_mode == OPT_NOLIVEMODE) &&
+        (options->live_buffer_size != DFLT_OPT_LIVE_BUFFER_SIZE)) {
+        fprintf(stderr,
+            "Option -B can only be used with option -L.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->live_lookahead != DFLT_OPT_LIVE_LOOKAHEAD) &&
+        ((options->live_mode == OPT_NOLIVEMODE) ||
+        (options->max_size == DFLT_OPT_MAX_SIZE))) {
+        fprintf(stderr,
+            "Option -A can only be used with options -L and -s.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->live_open_parts != DFLT_OPT_LIVE_OPEN_PARTS) &&
+        ((options->live_mode == OPT_NOLIVEMODE) ||
+        (options->max_size == DFLT_OPT_MAX_SIZE))) {
+        fprintf(stderr,
+            "Option -P can only be used with options -L and -s.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->live_open_parts != DFLT_OPT_LIVE_OPEN_PARTS) &&
+        (options->live_lookahead != DFLT_OPT_LIVE_LOOKAHEAD)) {
+        fprintf(stderr,
+            "Option -P is incompatible with option -A.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->num_parts == DFLT_OPT_NUM_PARTS) &&
+        (options->mem_limit != DFLT_OPT_MEM_LIMIT)) {
+        fprintf(stderr,
+            "Option -M can only be used with option -n.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->mem_limit == DFLT_OPT_MEM_LIMIT) &&
+        (options->tmp_dir != NULL)) {
+        fprintf(stderr,
+            "Option -T can only be used with option -M.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->checkpoint_entries != DFLT_OPT_CHECKPOINT_ENTRIES) &&
+        ((options->num_parts == DFLT_OPT_NUM_PARTS) ||
+        (options->out_filename == NULL))) {
+        fprintf(stderr,
+            "Option -K can only be used with options -n and -o.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->num_parts == DFLT_OPT_NUM_PARTS) &&
+        (options->file_cost != DFLT_OPT_FILE_COST)) {
+        fprintf(stderr,
+            "Option -c can only be used with option -n.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->checkpoint_entries != DFLT_OPT_CHECKPOINT_ENTRIES) &&
+        (options->mem_limit != DFLT_OPT_MEM_LIMIT)) {
+        fprintf(stderr,
+            "Option -K is incompatible with option -M.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    if((options->num_parts == DFLT_OPT_NUM_PARTS) &&
+        (options->refine_time != DFLT_OPT_REFINE_TIME)) {
+        fprintf(stderr,
+            "Option -R can only be used with option -n.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    /* partitions are written as soon as they are dispatched */
+    if((options->refine_time != DFLT_OPT_REFINE_TIME) &&
+        ((options->mem_limit != DFLT_OPT_MEM_LIMIT) ||
+        (options->checkpoint_entries != DFLT_OPT_CHECKPOINT_ENTRIES))) {
+        fprintf(stderr,
+            "Option -R is incompatible with options -M and -K.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    /* live partitions are written while crawling */
+    if((options->live_mode != DFLT_OPT_LIVEMODE) &&
+        ((options->mem_limit != DFLT_OPT_MEM_LIMIT) ||
+        (options->checkpoint_entries != DFLT_OPT_CHECKPOINT_ENTRIES) ||
+        (options->refine_time != DFLT_OPT_REFINE_TIME))) {
+        fprintf(stderr,
+            "Options -M, -K and -R are incompatible with option -L.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
+    /* directory sizes cannot be computed from changed files only */
+    if((options->index_filename != NULL) &&
+        ((options->dir_depth != DFLT_OPT_DIR_DEPTH) ||
+        (options->leaf_dirs != DFLT_OPT_LEAFDIRS) ||
+        (options->dirs_only != DFLT_OPT_DIRSONLY))) {
+        fprintf(stderr,
+            "Option -I is incompatible with options -d, -D and -E.\n");
+        return (FPART_OPTS_USAGE | FPART_OPTS_NOK | FPART_OPTS_EXIT);
+    }
+
     if((options->in_filename == NULL) && (*argcp <= 0)) {
         /* no file specified, force stdin */
         char *opt_input = "-";
@@ -604,6 +982,21 @@ int main(int argc, char **argv)
     /* our main double-linked file list */
     struct file_entry *head = NULL;
 
+    /* load previous index */
+    if((options.index_filename != NULL) &&
+        (load_crawl_index(options.index_filename, &options) != 0)) {
+        uninit_options(&options);
+        exit(EXIT_FAILURE);
+    }
+
+    /* create binary file list */
+    if((options.list_filename != NULL) &&
+        (init_file_list_output(options.list_filename) != 0)) {
+        uninit_crawl_index();
+        uninit_options(&options);
+        exit(EXIT_FAILURE);
+    }
+
     if(options.verbose >= OPT_VERBOSE)
         fprintf(stderr, "Examining filesystem...\n");
 
@@ -621,33 +1014,55 @@ int main(int argc, char **argv)
             if((in_fp = fopen(options.in_filename, "r")) == NULL) {
                 fprintf(stderr, "%s: %s\n", options.in_filename,
                     strerror(errno));
+                uninit_file_list_output();
+                uninit_crawl_index();
                 uninit_options(&options);
                 exit(EXIT_FAILURE);
             }
         }
 
-        /* read fd and do the work */
-        char line[MAX_LINE_LENGTH];
-        char *line_end_p = NULL;
-        bzero(line, MAX_LINE_LENGTH);
-        while(fgets(line, MAX_LINE_LENGTH, in_fp) != NULL) {
-            /* replace '\n' with '\0' */
-            if ((line_end_p = strchr(line, '\n')) != NULL)
-                *line_end_p = '\0';
-
-            if(handle_argument(line, &totalfiles, &head, &options) != 0) {
-                uninit_file_entries(head, &options);
+        /* binary file list, memory-map it */
+        if(is_file_list(fileno(in_fp))) {
+            if(init_file_entries_from_list(fileno(in_fp),
+                options.in_filename, &head, &totalfiles, &options) != 0) {
+                fclose(in_fp);
+                uninit_file_entries(&options);
+                uninit_file_list_output();
+                uninit_crawl_index();
                 uninit_options(&options);
                 exit(EXIT_FAILURE);
             }
-
-            /* cleanup */
-            bzero(line, MAX_LINE_LENGTH);
         }
+        else {
+            /* read fd and do the work */
+            struct line_reader reader;
+            char *line = NULL;
+            if(init_line_reader(&reader, fileno(in_fp)) != 0) {
+                fclose(in_fp);
+                uninit_file_entries(&options);
+                uninit_file_list_output();
+                uninit_crawl_index();
+                uninit_options(&options);
+                exit(EXIT_FAILURE);
+            }
+            while((line = read_line(&reader, NULL)) != NULL) {
+                if(handle_argument(line, &totalfiles, &head, &options) != 0) {
+                    uninit_line_reader(&reader);
+                    fclose(in_fp);
+                    str_cleanup(&crawl_paths, &num_crawl_paths);
+                    uninit_file_entries(&options);
+                    uninit_file_list_output();
+                    uninit_crawl_index();
+                    uninit_options(&options);
+                    exit(EXIT_FAILURE);
+                }
+            }
 
-        /* check for error reading input */
-        if(ferror(in_fp) != 0) {
-            fprintf(stderr, "error reading from input stream\n"); 
+            /* check for error reading input */
+            if(errno != 0) {
+                fprintf(stderr, "error reading from input stream\n"); 
+            }
+            uninit_line_reader(&reader);
         }
 
         /* cleanup */
@@ -663,12 +1078,59 @@ int main(int argc, char **argv)
     int i;
     for(i = 0 ; i < argc ; i++) {
         if(handle_argument(argv[i], &totalfiles, &head, &options) != 0) {
-            uninit_file_entries(head, &options);
+            str_cleanup(&crawl_paths, &num_crawl_paths);
+            uninit_file_entries(&options);
+            uninit_file_list_output();
+            uninit_crawl_index();
             uninit_options(&options);
             exit(EXIT_FAILURE);
         }
     }
 
+    /* crawl remaining paths */
+    if(crawl_pending_paths(&totalfiles, &head, &options) != 0) {
+        uninit_file_entries(&options);
+        uninit_file_list_output();
+        uninit_crawl_index();
+        uninit_options(&options);
+        exit(EXIT_FAILURE);
+    }
+
+    /* print entries still held back in live mode (option -A) and flush
+       partition files (option -n) */
+    if((options.live_mode == OPT_LIVEMODE) &&
+        (live_flush_file_entries(&options) != 0)) {
+        uninit_file_entries(&options);
+        uninit_file_list_output();
+        uninit_crawl_index();
+        uninit_options(&options);
+        exit(EXIT_FAILURE);
+    }
+
+    /* close binary file list */
+    if(uninit_file_list_output() != 0) {
+        fprintf(stderr, "%s: cannot write file list\n",
+            options.list_filename);
+        uninit_crawl_index();
+        uninit_file_entries(&options);
+        uninit_options(&options);
+        exit(EXIT_FAILURE);
+    }
+
+    /* replace previous index */
+    if(options.index_filename != NULL) {
+        if(options.verbose >= OPT_VERBOSE)
+            fprintf(stderr, "Saving index...\n");
+        if(save_crawl_index(options.index_filename) != 0) {
+            fprintf(stderr, "%s(): cannot save index\n", __func__);
+            uninit_crawl_index();
+            uninit_file_entries(&options);
+            uninit_options(&options);
+            exit(EXIT_FAILURE);
+        }
+        uninit_crawl_index();
+    }
+
 /****************
   Display status
 *****************/
@@ -678,7 +1140,7 @@ int main(int argc, char **argv)
 
     /* no file found or live mode */
     if((totalfiles <= 0) || (options.live_mode == OPT_LIVEMODE)) {
-        uninit_file_entries(head, &options);
+        uninit_file_entries(&options);
         /* display status */
         if(options.verbose >= OPT_VERBOSE)
             fprintf(stderr, "%lld file(s) found.\n", totalfiles);
@@ -689,6 +1151,7 @@ int main(int argc, char **argv)
     /* display status */
     if(options.verbose >= OPT_VERBOSE) {
         fprintf(stderr, "%lld file(s) found.\n", totalfiles);
+        print_file_entries_memory();
         fprintf(stderr, "Sorting entries...\n");
     }
 
@@ -696,17 +1159,59 @@ int main(int argc, char **argv)
   Sort entries with a fixed number of partitions
 *************************************************/
 
-    /* our list of partitions */
-    struct partition *part_head = NULL;
+    /* our table of partitions */
+    struct partition_table partitions;
+    init_partitions(&partitions);
     pnum_t num_parts = options.num_parts;
 
+    /* file entries have been spilled to temporary files (option -M),
+       sort and dispatch them using an external merge */
+    int ext_sorted = (ext_sort_num_runs() > 0);
+
+    if(ext_sorted) {
+        /* create a table of partitions which will hold dispatched files */
+        if(add_partitions(&partitions, options.num_parts, &options) != 0) {
+            fprintf(stderr, "%s(): cannot init table of partitions\n",
+                __func__);
+            uninit_partitions(&partitions);
+            uninit_file_entries(&options);
+            uninit_ext_sort();
+            uninit_options(&options);
+            exit(EXIT_FAILURE);
+        }
+        /* dispatch files and write partitions */
+        if(ext_sort_dispatch(&head, totalfiles, &partitions, &options) != 0) {
+            fprintf(stderr, "%s(): unable to dispatch file entries\n",
+                __func__);
+            uninit_partitions(&partitions);
+            uninit_file_entries(&options);
+            uninit_ext_sort();
+            uninit_options(&options);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* file entries have been dispatched and written on a regular basis
+       (option -K), flush remaining ones */
+    else if(options.checkpoint_entries != DFLT_OPT_CHECKPOINT_ENTRIES) {
+        if(checkpoint_finish(&head, &partitions, &options) != 0) {
+            fprintf(stderr, "%s(): unable to dispatch file entries\n",
+                __func__);
+            uninit_partitions(&partitions);
+            uninit_file_entries(&options);
+            uninit_checkpoint();
+            uninit_options(&options);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     /* sort files with a fixed size of partitions */
-    if(options.num_parts != DFLT_OPT_NUM_PARTS) {
+    else if(options.num_parts != DFLT_OPT_NUM_PARTS) {
         /* create a fixed-size array of pointers to sort */
         struct file_entry **file_entry_p = NULL;
 
         if_not_malloc(file_entry_p, sizeof(struct file_entry *) * totalfiles,
-            uninit_file_entries(head, &options);
+            uninit_file_entries(&options);
             uninit_options(&options);
             exit(EXIT_FAILURE);
         )
@@ -714,44 +1219,64 @@ int main(int argc, char **argv)
         /* initialize array */
         init_file_entry_p(file_entry_p, totalfiles, head);
     
-        /* sort array */
-        qsort(&file_entry_p[0], totalfiles, sizeof(struct file_entry *),
-            &sort_file_entry_p);
+        /* sort array, fall back to qsort(3) if radix sort cannot get
+           enough memory */
+        if(radix_sort_file_entry_p(file_entry_p, totalfiles) != 0)
+            qsort(&file_entry_p[0], totalfiles, sizeof(struct file_entry *),
+                &sort_file_entry_p);
     
-        /* create a double_linked list of partitions
-           which will hold dispatched files */
-        if(add_partitions(&part_head, options.num_parts, &options) != 0) {
-            fprintf(stderr, "%s(): cannot init list of partitions\n",
+        /* create a table of partitions which will hold dispatched files */
+        if(add_partitions(&partitions, options.num_parts, &options) != 0) {
+            fprintf(stderr, "%s(): cannot init table of partitions\n",
                 __func__);
-            uninit_partitions(part_head);
+            uninit_partitions(&partitions);
             free(file_entry_p);
-            uninit_file_entries(head, &options);
+            uninit_file_entries(&options);
             uninit_options(&options);
             exit(EXIT_FAILURE);
         }
-        /* come back to the first element */
-        rewind_list(part_head);
-    
         /* dispatch files */
         if(dispatch_file_entry_p_by_size
-            (file_entry_p, totalfiles, part_head, options.num_parts) != 0) {
+            (file_entry_p, totalfiles, &partitions, options.file_cost) != 0) {
             fprintf(stderr, "%s(): unable to dispatch file entries\n",
                 __func__);
-            uninit_partitions(part_head);
+            uninit_partitions(&partitions);
             free(file_entry_p);
-            uninit_file_entries(head, &options);
+            uninit_file_entries(&options);
             uninit_options(&options);
             exit(EXIT_FAILURE);
         }
+
+        /* refine dispatch (option -R) */
+        if(options.refine_time != DFLT_OPT_REFINE_TIME) {
+            if(options.verbose >= OPT_VERBOSE)
+                fprintf(stderr, "Imbalance (max/mean): %.6f\n"
+                    "Refining partitions...\n",
+                    partitions_imbalance(&partitions, options.file_cost));
+            if(refine_file_entry_p(file_entry_p, totalfiles, &partitions,
+                options.file_cost, options.refine_time) != 0) {
+                fprintf(stderr, "%s(): unable to refine partitions\n",
+                    __func__);
+                uninit_partitions(&partitions);
+                free(file_entry_p);
+                uninit_file_entries(&options);
+                uninit_options(&options);
+                exit(EXIT_FAILURE);
+            }
+            if(options.verbose >= OPT_VERBOSE)
+                fprintf(stderr, "Imbalance (max/mean): %.6f\n",
+                    partitions_imbalance(&partitions, options.file_cost));
+        }
     
-        /* re-dispatch empty files */
-        if(dispatch_empty_file_entries
-            (head, totalfiles, part_head, options.num_parts) != 0) {
+        /* re-dispatch empty files, unless files have a cost (they have
+           then been spread already) */
+        if((options.file_cost == 0) && (dispatch_empty_file_entries
+            (head, totalfiles, &partitions) != 0)) {
             fprintf(stderr, "%s(): unable to dispatch empty file entries\n",
                 __func__);
-            uninit_partitions(part_head);
+            uninit_partitions(&partitions);
             free(file_entry_p);
-            uninit_file_entries(head, &options);
+            uninit_file_entries(&options);
             uninit_options(&options);
             exit(EXIT_FAILURE);
         }
@@ -767,20 +1292,39 @@ int main(int argc, char **argv)
     /* sort files with a file number or size limit per-partitions.
        In this case, partitions are dynamically-created */
     else {
+        /* pack biggest files first (option -S), using a sorted array of
+           pointers */
+        struct file_entry **file_entry_p = NULL;
+
+        if(options.sort_by_size == OPT_SORTBYSIZE) {
+            if_not_malloc(file_entry_p,
+                sizeof(struct file_entry *) * totalfiles,
+                uninit_file_entries(&options);
+                uninit_options(&options);
+                exit(EXIT_FAILURE);
+            )
+            init_file_entry_p(file_entry_p, totalfiles, head);
+            if(radix_sort_file_entry_p(file_entry_p, totalfiles) != 0)
+                qsort(&file_entry_p[0], totalfiles,
+                    sizeof(struct file_entry *), &sort_file_entry_p);
+        }
+
         if((num_parts = dispatch_file_entries_by_limits
-            (head, &part_head, options.max_entries, options.max_size,
-            &options)) == 0) {
+            (head, file_entry_p, totalfiles, &partitions, options.max_entries,
+            options.max_size, &options)) == 0) {
             fprintf(stderr, "%s(): unable to dispatch file entries\n",
                 __func__);
-            uninit_partitions(part_head);
-            uninit_file_entries(head, &options);
+            uninit_partitions(&partitions);
+            if(file_entry_p != NULL)
+                free(file_entry_p);
+            uninit_file_entries(&options);
             uninit_options(&options);
             exit(EXIT_FAILURE);
         }
-        /* come back to the first element
-           (we may have exited with part_head set to partition 1, 
-           after default partition) */
-        rewind_list(part_head);
+
+        /* cleanup */
+        if(file_entry_p != NULL)
+            free(file_entry_p);
     }
 
 /***********************
@@ -788,20 +1332,25 @@ int main(int argc, char **argv)
 ************************/
 
     /* print result summary */
-    print_partitions(part_head);
+    print_partitions(&partitions);
 
     if(options.verbose >= OPT_VERBOSE)
         fprintf(stderr, "Writing output lists...\n");
 
     /* print file entries */
-    print_file_entries(head, num_parts, &options);
+    if(ext_sorted)
+        ext_sort_print_file_entries();
+    else if(options.checkpoint_entries == DFLT_OPT_CHECKPOINT_ENTRIES)
+        print_file_entries(head, num_parts, &options);
 
     if(options.verbose >= OPT_VERBOSE)
         fprintf(stderr, "Cleaning up...\n");
 
     /* free stuff */
-    uninit_partitions(part_head);
-    uninit_file_entries(head, &options);
+    uninit_partitions(&partitions);
+    uninit_file_entries(&options);
+    uninit_ext_sort();
+    uninit_checkpoint();
     uninit_options(&options);
     exit(EXIT_SUCCESS);
 }
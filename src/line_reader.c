@@ -0,0 +1,202 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "line_reader.h"
+
+/* fprintf(3) */
+#include <stdio.h>
+
+/* free(3) */
+#include <stdlib.h>
+
+/* strerror(3), memchr(3), memmove(3) */
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* read(2) */
+#include <unistd.h>
+
+/* LLONG_MAX */
+#include <limits.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/* Initialize a line reader for fd
+   - returns 0 (success) or 1 (failure) */
+int
+init_line_reader(struct line_reader *reader, int fd)
+{
+    assert(reader != NULL);
+    assert(fd >= 0);
+
+    reader->fd = fd;
+    reader->size = LINE_READER_BUFFER_SIZE;
+    reader->start = 0;
+    reader->scanned = 0;
+    reader->end = 0;
+    reader->eof = 0;
+    if_not_malloc(reader->buf, reader->size + 1,
+        return (1);
+    )
+
+    return (0);
+}
+
+/* Get next line from reader ; its ending '\n' is replaced with a '\0'
+   The line returned is only valid until the next call
+   - returns a pointer to the line (and its length, if len is not NULL)
+     or NULL at end of file or on error (errno is then set) */
+char *
+read_line(struct line_reader *reader, size_t *len)
+{
+    assert(reader != NULL);
+    assert(reader->buf != NULL);
+
+    errno = 0;
+    while(1) {
+        /* look for a complete line */
+        char *line = &reader->buf[reader->start];
+        char *line_end = memchr(line + reader->scanned, '\n',
+            reader->end - reader->start - reader->scanned);
+        if(line_end != NULL) {
+            *line_end = '\0';
+            reader->start += (line_end - line) + 1;
+            reader->scanned = 0;
+            if(len != NULL)
+                *len = line_end - line;
+            return (line);
+        }
+        reader->scanned = reader->end - reader->start;
+
+        /* last line, without an ending '\n' (buf has room for a '\0') */
+        if(reader->eof) {
+            if(reader->scanned == 0)
+                return (NULL);
+            reader->buf[reader->end] = '\0';
+            reader->start = reader->end;
+            reader->scanned = 0;
+            if(len != NULL)
+                *len = reader->end - (line - reader->buf);
+            return (line);
+        }
+
+        /* move remaining data to the beginning of buffer */
+        if(reader->start > 0) {
+            memmove(reader->buf, &reader->buf[reader->start],
+                reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->start = 0;
+        }
+
+        /* line does not fit, enlarge buffer */
+        if(reader->end == reader->size) {
+            reader->size *= 2;
+            if_not_realloc(reader->buf, reader->size + 1,
+                errno = ENOMEM;
+                return (NULL);
+            )
+        }
+
+        /* read more data */
+        ssize_t read_size = read(reader->fd, &reader->buf[reader->end],
+            reader->size - reader->end);
+        if(read_size < 0) {
+            if(errno == EINTR)
+                continue;
+            fprintf(stderr, "%s(): %s\n", __func__, strerror(errno));
+            return (NULL);
+        }
+        if(read_size == 0)
+            reader->eof = 1;
+        reader->end += read_size;
+    }
+}
+
+/* Uninitialize a line reader */
+void
+uninit_line_reader(struct line_reader *reader)
+{
+    assert(reader != NULL);
+
+    if(reader->buf != NULL) {
+        free(reader->buf);
+        reader->buf = NULL;
+    }
+}
+
+/* Parse an arbitrary value, following the "size(blank)path" scheme
+   (leading blanks are skipped, path ends with a '\n' or a '\0')
+   str is modified in place and path points within str
+   - returns 0 (success) or 1 (failure) */
+int
+parse_arbitrary_value(char *str, fsize_t *size, char **path)
+{
+    assert(str != NULL);
+    assert(size != NULL);
+    assert(path != NULL);
+
+    /* skip leading blanks */
+    while((*str == ' ') || ((*str >= '\t') && (*str <= '\r')))
+        str++;
+
+    /* sign */
+    int negative = 0;
+    if((*str == '-') || (*str == '+')) {
+        negative = (*str == '-');
+        str++;
+    }
+
+    /* digits */
+    if((*str < '0') || (*str > '9'))
+        return (1);
+    unsigned long long value = 0;
+    while((*str >= '0') && (*str <= '9')) {
+        unsigned int digit = *str - '0';
+        if(value > ((unsigned long long)LLONG_MAX - digit) / 10)
+            return (1);
+        value = (value * 10) + digit;
+        str++;
+    }
+
+    /* blanks, then path */
+    while((*str == ' ') || ((*str >= '\t') && (*str <= '\r')))
+        str++;
+    if(*str == '\0')
+        return (1);
+    *path = str;
+    while((*str != '\0') && (*str != '\n'))
+        str++;
+    *str = '\0';
+
+    *size = negative ? -(fsize_t)value : (fsize_t)value;
+    return (0);
+}
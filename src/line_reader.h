@@ -0,0 +1,57 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _LINE_READER_H
+#define _LINE_READER_H
+
+#include "types.h"
+
+/* size_t */
+#include <stddef.h>
+
+#if !defined(LINE_READER_BUFFER_SIZE)
+#define LINE_READER_BUFFER_SIZE (1024 * 1024) /* initial buffer size */
+#endif
+
+/* A line reader, reading large blocks from a file descriptor and returning
+   lines in place (without copying them) */
+struct line_reader {
+    int fd;                         /* file descriptor read */
+    char *buf;                      /* buffer, with room for an ending '\0' */
+    size_t size;                    /* buffer size (without ending '\0') */
+    size_t start;                   /* start of next line, within buf */
+    size_t scanned;                 /* data scanned so far, from start */
+    size_t end;                     /* end of data read, within buf */
+    unsigned char eof;              /* end of file reached */
+};
+
+int init_line_reader(struct line_reader *reader, int fd);
+char *read_line(struct line_reader *reader, size_t *len);
+void uninit_line_reader(struct line_reader *reader);
+int parse_arbitrary_value(char *str, fsize_t *size, char **path);
+
+#endif /* _LINE_READER_H */
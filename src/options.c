@@ -45,6 +45,8 @@ init_options(struct program_options *options)
     assert(DFLT_OPT_NUM_PARTS >= 0);
     assert(DFLT_OPT_MAX_ENTRIES >= 0);
     assert(DFLT_OPT_MAX_SIZE >= 0);
+    assert((DFLT_OPT_SORTBYSIZE == OPT_NOSORTBYSIZE) ||
+           (DFLT_OPT_SORTBYSIZE == OPT_SORTBYSIZE));
     assert((DFLT_OPT_ARBITRARYVALUES == OPT_NOARBITRARYVALUES) ||
            (DFLT_OPT_ARBITRARYVALUES == OPT_ARBITRARYVALUES));
     assert((DFLT_OPT_OUT0 == OPT_NOOUT0) ||
@@ -58,6 +60,7 @@ init_options(struct program_options *options)
            (DFLT_OPT_FOLLOWSYMLINKS == OPT_NOFOLLOWSYMLINKS));
     assert((DFLT_OPT_CROSSFSBOUNDARIES == OPT_NOCROSSFSBOUNDARIES) ||
            (DFLT_OPT_CROSSFSBOUNDARIES == OPT_CROSSFSBOUNDARIES));
+    assert(DFLT_OPT_NUM_THREADS >= 1);
     assert((DFLT_OPT_DIRSINCLUDE == OPT_NOEMPTYDIRS) ||
            (DFLT_OPT_DIRSINCLUDE == OPT_EMPTYDIRS) ||
            (DFLT_OPT_DIRSINCLUDE == OPT_DNREMPTY) ||
@@ -69,22 +72,33 @@ init_options(struct program_options *options)
            (DFLT_OPT_DIRSONLY == OPT_DIRSONLY));
     assert((DFLT_OPT_LIVEMODE == OPT_NOLIVEMODE) ||
            (DFLT_OPT_LIVEMODE == OPT_LIVEMODE));
+    assert(DFLT_OPT_LIVE_BUFFER_SIZE >= 0);
+    assert(DFLT_OPT_LIVE_LOOKAHEAD >= 0);
+    assert(DFLT_OPT_LIVE_OPEN_PARTS >= 1);
     assert(DFLT_OPT_PRELOAD_SIZE >= 0);
     assert(DFLT_OPT_OVERLOAD_SIZE >= 0);
     assert(DFLT_OPT_ROUND_SIZE >= 1);
+    assert(DFLT_OPT_MEM_LIMIT >= 0);
+    assert(DFLT_OPT_CHECKPOINT_ENTRIES >= 0);
+    assert(DFLT_OPT_FILE_COST >= 0);
+    assert(DFLT_OPT_REFINE_TIME >= 0);
 
     /* set default options */
     options->num_parts = DFLT_OPT_NUM_PARTS;
     options->max_entries = DFLT_OPT_MAX_ENTRIES;
     options->max_size = DFLT_OPT_MAX_SIZE;
+    options->sort_by_size = DFLT_OPT_SORTBYSIZE;
     options->in_filename = NULL;
     options->arbitrary_values = DFLT_OPT_ARBITRARYVALUES;
     options->out_filename = NULL;
+    options->list_filename = NULL;
     options->out_zero = DFLT_OPT_OUT0;
     options->add_slash = DFLT_OPT_ADDSLASH;
     options->verbose = DFLT_OPT_VERBOSE;
     options->follow_symbolic_links = DFLT_OPT_FOLLOWSYMLINKS;
     options->cross_fs_boundaries = DFLT_OPT_CROSSFSBOUNDARIES;
+    options->num_threads = DFLT_OPT_NUM_THREADS;
+    options->index_filename = NULL;
     options->include_files = NULL;
     options->ninclude_files = 0;
     options->include_files_ci = NULL;
@@ -100,18 +114,37 @@ init_options(struct program_options *options)
     options->live_mode = DFLT_OPT_LIVEMODE;
     options->pre_part_hook = NULL;
     options->post_part_hook = NULL;
+    options->async_hooks = DFLT_OPT_ASYNC_HOOKS;
+    options->live_buffer_size = DFLT_OPT_LIVE_BUFFER_SIZE;
+    options->live_lookahead = DFLT_OPT_LIVE_LOOKAHEAD;
+    options->live_open_parts = DFLT_OPT_LIVE_OPEN_PARTS;
     options->preload_size = DFLT_OPT_PRELOAD_SIZE;
     options->overload_size = DFLT_OPT_OVERLOAD_SIZE;
     options->round_size = DFLT_OPT_ROUND_SIZE;
+    options->mem_limit = DFLT_OPT_MEM_LIMIT;
+    options->tmp_dir = NULL;
+    options->checkpoint_entries = DFLT_OPT_CHECKPOINT_ENTRIES;
+    options->file_cost = DFLT_OPT_FILE_COST;
+    options->refine_time = DFLT_OPT_REFINE_TIME;
 }
 
 /* Un-initialize global options structure */
 void
 uninit_options(struct program_options *options)
 {
+    options->refine_time = DFLT_OPT_REFINE_TIME;
+    options->file_cost = DFLT_OPT_FILE_COST;
+    options->checkpoint_entries = DFLT_OPT_CHECKPOINT_ENTRIES;
+    if(options->tmp_dir != NULL)
+        free(options->tmp_dir);
+    options->mem_limit = DFLT_OPT_MEM_LIMIT;
     options->round_size = DFLT_OPT_ROUND_SIZE;
     options->overload_size = DFLT_OPT_OVERLOAD_SIZE;
     options->preload_size = DFLT_OPT_PRELOAD_SIZE;
+    options->live_open_parts = DFLT_OPT_LIVE_OPEN_PARTS;
+    options->live_lookahead = DFLT_OPT_LIVE_LOOKAHEAD;
+    options->live_buffer_size = DFLT_OPT_LIVE_BUFFER_SIZE;
+    options->async_hooks = DFLT_OPT_ASYNC_HOOKS;
     if(options->post_part_hook != NULL)
         free(options->post_part_hook);
     if(options->pre_part_hook != NULL)
@@ -133,16 +166,22 @@ uninit_options(struct program_options *options)
     if(options->include_files != NULL)
         str_cleanup(&(options->include_files),
             &(options->ninclude_files));
+    if(options->index_filename != NULL)
+        free(options->index_filename);
+    options->num_threads = DFLT_OPT_NUM_THREADS;
     options->cross_fs_boundaries = DFLT_OPT_CROSSFSBOUNDARIES;
     options->follow_symbolic_links = DFLT_OPT_FOLLOWSYMLINKS;
     options->verbose = DFLT_OPT_VERBOSE;
     options->add_slash = DFLT_OPT_ADDSLASH;
     options->out_zero = DFLT_OPT_OUT0;
+    if(options->list_filename != NULL)
+        free(options->list_filename);
     if(options->out_filename != NULL)
         free(options->out_filename);
     options->arbitrary_values = DFLT_OPT_ARBITRARYVALUES;
     if(options->in_filename != NULL)
         free(options->in_filename);
+    options->sort_by_size = DFLT_OPT_SORTBYSIZE;
     options->max_size = DFLT_OPT_MAX_SIZE;
     options->max_entries = DFLT_OPT_MAX_ENTRIES;
     options->num_parts = DFLT_OPT_NUM_PARTS;
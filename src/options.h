@@ -46,6 +46,11 @@ struct program_options {
 /* maximum partition size (option -s) */
 #define DFLT_OPT_MAX_SIZE           0
     fsize_t max_size;
+/* pack biggest files first, with -f or -s (option -S) */
+#define OPT_NOSORTBYSIZE            0
+#define OPT_SORTBYSIZE              1
+#define DFLT_OPT_SORTBYSIZE         OPT_NOSORTBYSIZE
+    unsigned char sort_by_size;
 /* input file (option -i); NULL = undefined, "-" = stdin, "filename" */
     char *in_filename;
 /* arbitrary values (option -a) */
@@ -55,6 +60,8 @@ struct program_options {
     unsigned char arbitrary_values;
 /* output file (option -o); NULL = stdout, "filename" */
     char *out_filename;
+/* binary file list output (option -O); NULL = none, "filename" */
+    char *list_filename;
 /* add a null character after filename in file lists */
 #define OPT_NOOUT0                  0
 #define OPT_OUT0                    1
@@ -81,6 +88,11 @@ struct program_options {
 #define OPT_CROSSFSBOUNDARIES       1
 #define DFLT_OPT_CROSSFSBOUNDARIES  OPT_CROSSFSBOUNDARIES
     unsigned char cross_fs_boundaries;
+/* number of crawling threads (option -t) */
+#define DFLT_OPT_NUM_THREADS        1
+    unsigned int num_threads;
+/* crawl index (option -I); NULL = none, "filename" */
+    char *index_filename;
 /* include files, case sensitive (option -y) */
     char **include_files;
     unsigned int ninclude_files;
@@ -123,6 +135,19 @@ struct program_options {
     char *pre_part_hook;
 /* post-partition hook (option -W) */
     char *post_part_hook;
+/* post-partition hooks run asynchronously, 0 = synchronous (option -H) */
+#define DFLT_OPT_ASYNC_HOOKS        0
+    unsigned int async_hooks;
+/* live mode write buffer size (option -B) */
+#define DFLT_OPT_LIVE_BUFFER_SIZE   65536
+    size_t live_buffer_size;
+/* live mode lookahead, number of entries held back to fill partitions,
+   0 = none (option -A) */
+#define DFLT_OPT_LIVE_LOOKAHEAD     0
+    unsigned int live_lookahead;
+/* live mode, number of partitions open at once (option -P) */
+#define DFLT_OPT_LIVE_OPEN_PARTS    1
+    unsigned int live_open_parts;
 /* preload partitions (option -p) */
 #define DFLT_OPT_PRELOAD_SIZE       0
     fsize_t preload_size;
@@ -132,6 +157,21 @@ struct program_options {
 /* round file size up (option -r) */
 #define DFLT_OPT_ROUND_SIZE         1
     fsize_t round_size;
+/* memory limit for file entries, 0 = unlimited (option -M) */
+#define DFLT_OPT_MEM_LIMIT          0
+    size_t mem_limit;
+/* temporary directory (option -T); NULL = $TMPDIR or /tmp */
+    char *tmp_dir;
+/* checkpoint every n file entries, 0 = never (option -K) */
+#define DFLT_OPT_CHECKPOINT_ENTRIES 0
+    fnum_t checkpoint_entries;
+/* cost of a file, in bytes, when balancing partitions (option -c) */
+#define DFLT_OPT_FILE_COST          0
+    fsize_t file_cost;
+/* time allowed to refine partitions after dispatch, in milliseconds,
+   0 = no refinement (option -R) */
+#define DFLT_OPT_REFINE_TIME        0
+    unsigned int refine_time;
 };
 
 void init_options(struct program_options *options);
@@ -0,0 +1,436 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "types.h"
+#include "utils.h"
+#include "output.h"
+
+/* fprintf(3), snprintf(3) */
+#include <stdio.h>
+
+/* malloc(3) */
+#include <stdlib.h>
+
+/* strerror(3), strlen(3), memcpy(3) */
+#include <string.h>
+
+/* errno */
+#include <errno.h>
+
+/* open(2) */
+#include <fcntl.h>
+
+/* write(2), close(2) */
+#include <unistd.h>
+
+/* getrlimit(2), setrlimit(2) */
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* assert(3) */
+#include <assert.h>
+
+/************************
+ Output buffers functions
+ ************************/
+
+/* Write a whole buffer to a file descriptor, handling short writes
+   - returns 0 (success) or 1 (failure) */
+static int
+write_all(int fd, const char *data, size_t len)
+{
+    assert(fd >= 0);
+    assert((data != NULL) || (len == 0));
+
+    while(len > 0) {
+        ssize_t written = write(fd, data, len);
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+            return (1);
+        }
+        data += written;
+        len -= written;
+    }
+    return (0);
+}
+
+/* Initialize an output buffer for a file descriptor (may be -1 and set
+   later) ; a size of 0 disables buffering */
+void
+init_out_buffer(struct out_buffer *buffer, int fd, size_t size)
+{
+    assert(buffer != NULL);
+
+    buffer->fd = fd;
+    buffer->data = NULL;
+    buffer->size = size;
+    buffer->used = 0;
+}
+
+/* Flush an output buffer to its file descriptor
+   - returns 0 (success) or 1 (failure) */
+int
+out_buffer_flush(struct out_buffer *buffer)
+{
+    assert(buffer != NULL);
+
+    if(buffer->used == 0)
+        return (0);
+
+    assert(buffer->fd >= 0);
+    if(write_all(buffer->fd, buffer->data, buffer->used) != 0) {
+        fprintf(stderr, "%s\n", strerror(errno));
+        return (1);
+    }
+    buffer->used = 0;
+    return (0);
+}
+
+/* Write data through an output buffer, flushing it if necessary
+   - returns 0 (success) or 1 (failure) */
+int
+out_buffer_write(struct out_buffer *buffer, const char *data, size_t len)
+{
+    assert(buffer != NULL);
+    assert((data != NULL) || (len == 0));
+
+    if(buffer->used + len > buffer->size) {
+        if(out_buffer_flush(buffer) != 0)
+            return (1);
+
+        /* data does not fit into buffer, write it directly */
+        if(len > buffer->size) {
+            assert(buffer->fd >= 0);
+            if(write_all(buffer->fd, data, len) != 0) {
+                fprintf(stderr, "%s\n", strerror(errno));
+                return (1);
+            }
+            return (0);
+        }
+    }
+
+    if(buffer->data == NULL) {
+        if_not_malloc(buffer->data, buffer->size,
+            return (1);
+        )
+    }
+    memcpy(&buffer->data[buffer->used], data, len);
+    buffer->used += len;
+    return (0);
+}
+
+/* Un-initialize an output buffer, without flushing it nor closing its
+   file descriptor */
+void
+uninit_out_buffer(struct out_buffer *buffer)
+{
+    assert(buffer != NULL);
+
+    if(buffer->data != NULL)
+        free(buffer->data);
+    init_out_buffer(buffer, -1, 0);
+}
+
+/**********************
+ Output files functions
+ **********************/
+
+/* Compute the number of files that can be kept open at once, raising
+   RLIMIT_NOFILE up to its hard limit when needed */
+static pnum_t
+out_files_max_open(pnum_t num_files)
+{
+    struct rlimit limit;
+    rlim_t wanted = (rlim_t)num_files + OUTPUT_RESERVED_FDS;
+
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return (1);
+
+    if((limit.rlim_cur != RLIM_INFINITY) && (limit.rlim_cur < wanted)) {
+        struct rlimit new_limit = limit;
+        new_limit.rlim_cur = ((limit.rlim_max == RLIM_INFINITY) ||
+            (limit.rlim_max > wanted)) ? wanted : limit.rlim_max;
+        if(setrlimit(RLIMIT_NOFILE, &new_limit) == 0)
+            limit = new_limit;
+    }
+
+    if((limit.rlim_cur == RLIM_INFINITY) || (limit.rlim_cur >= wanted))
+        return (num_files);
+    if(limit.rlim_cur <= OUTPUT_RESERVED_FDS)
+        return (1);
+    return ((pnum_t)(limit.rlim_cur - OUTPUT_RESERVED_FDS));
+}
+
+/* Compute partition file name "template.index"
+   - returned pointer must be freed later */
+static char *
+out_files_filename(const struct out_files *files, pnum_t index)
+{
+    assert(files != NULL);
+    assert(files->template != NULL);
+
+    char *filename = NULL;
+    size_t malloc_size = strlen(files->template) + 1 + get_num_digits(index) +
+        1;
+    if_not_malloc(filename, malloc_size,
+        return (NULL);
+    )
+    snprintf(filename, malloc_size, "%s.%d", files->template, index);
+    return (filename);
+}
+
+/* Remove an open file from the LRU list */
+static void
+out_files_lru_remove(struct out_files *files, struct out_file *file)
+{
+    assert(files != NULL);
+    assert(file != NULL);
+
+    if(file->lru_prevp != NULL)
+        file->lru_prevp->lru_nextp = file->lru_nextp;
+    else
+        files->lru_head = file->lru_nextp;
+    if(file->lru_nextp != NULL)
+        file->lru_nextp->lru_prevp = file->lru_prevp;
+    else
+        files->lru_tail = file->lru_prevp;
+    file->lru_prevp = file->lru_nextp = NULL;
+}
+
+/* Insert an open file at the head of the LRU list */
+static void
+out_files_lru_push(struct out_files *files, struct out_file *file)
+{
+    assert(files != NULL);
+    assert(file != NULL);
+
+    file->lru_prevp = NULL;
+    file->lru_nextp = files->lru_head;
+    if(files->lru_head != NULL)
+        files->lru_head->lru_prevp = file;
+    else
+        files->lru_tail = file;
+    files->lru_head = file;
+}
+
+/* Flush and close a partition file
+   - returns 0 (success) or 1 (failure) */
+static int
+out_files_close(struct out_files *files, struct out_file *file)
+{
+    assert(files != NULL);
+    assert(file != NULL);
+    assert(file->buffer.fd >= 0);
+
+    int error = out_buffer_flush(&file->buffer);
+
+    out_files_lru_remove(files, file);
+    close(file->buffer.fd);
+    file->buffer.fd = -1;
+    files->num_open--;
+    return (error);
+}
+
+/* Open (create or re-open) a partition file, closing the least recently
+   used one if too many files are open
+   - returns 0 (success) or 1 (failure) */
+static int
+out_files_open(struct out_files *files, struct out_file *file)
+{
+    assert(files != NULL);
+    assert(file != NULL);
+
+    char *filename = NULL;
+    pnum_t index = file - files->files;
+
+    /* already open, just mark it as most recently used */
+    if(file->buffer.fd >= 0) {
+        if(files->lru_head != file) {
+            out_files_lru_remove(files, file);
+            out_files_lru_push(files, file);
+        }
+        return (0);
+    }
+
+    if((files->num_open >= files->max_open) &&
+        (out_files_close(files, files->lru_tail) != 0))
+        return (1);
+
+    if((filename = out_files_filename(files, index)) == NULL)
+        return (1);
+
+    /* files are truncated at creation, then appended to ; if we run out
+       of descriptors (e.g. used elsewhere in the program), close the
+       least recently used file and retry with less open files */
+    while((file->buffer.fd = open(filename, file->created ?
+        O_WRONLY|O_APPEND : O_WRONLY|O_CREAT|O_TRUNC, 0660)) < 0) {
+        if((errno == EMFILE) && (files->num_open > 0)) {
+            files->max_open = files->num_open;
+            if(out_files_close(files, files->lru_tail) != 0) {
+                free(filename);
+                return (1);
+            }
+            continue;
+        }
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        free(filename);
+        return (1);
+    }
+    free(filename);
+
+    file->created = 1;
+    files->num_open++;
+    out_files_lru_push(files, file);
+    return (0);
+}
+
+/* Initialize a set of partition files from a template
+   - files are created when first written to (or when un-initializing)
+   - each file is buffered using at most max_buffer_size bytes (0 disables
+     buffering)
+   - returns 0 (success) or 1 (failure) */
+int
+init_out_files(struct out_files *files, const char *template,
+    pnum_t num_files, size_t max_buffer_size)
+{
+    assert(files != NULL);
+    assert(template != NULL);
+    assert(num_files > 0);
+
+    size_t malloc_size = strlen(template) + 1;
+    size_t buffer_size = 0;
+    pnum_t i;
+
+    files->files = NULL;
+    if_not_malloc(files->template, malloc_size,
+        return (1);
+    )
+    snprintf(files->template, malloc_size, "%s", template);
+
+    if_not_malloc(files->files, sizeof(struct out_file) * num_files,
+        free(files->template);
+        files->template = NULL;
+        return (1);
+    )
+    files->num_files = num_files;
+    files->max_open = out_files_max_open(num_files);
+    files->num_open = 0;
+    files->lru_head = NULL;
+    files->lru_tail = NULL;
+
+    /* share buffers' memory among partitions */
+    buffer_size = OUTPUT_BUFFERS_SIZE / num_files;
+    buffer_size = max(buffer_size, OUTPUT_MIN_BUFFER_SIZE);
+    buffer_size = min(buffer_size, OUTPUT_MAX_BUFFER_SIZE);
+    buffer_size = min(buffer_size, max_buffer_size);
+
+    for(i = 0 ; i < num_files ; i++) {
+        init_out_buffer(&files->files[i].buffer, -1, buffer_size);
+        files->files[i].created = 0;
+        files->files[i].lru_prevp = NULL;
+        files->files[i].lru_nextp = NULL;
+    }
+
+#if defined(DEBUG)
+    fprintf(stderr, "%s(): %u file(s), %u open at once, %zu bytes buffers\n",
+        __func__, num_files, files->max_open, buffer_size);
+#endif
+
+    return (0);
+}
+
+/* Write data to a partition file
+   - returns 0 (success) or 1 (failure) */
+int
+out_files_write(struct out_files *files, pnum_t index, const char *data,
+    size_t len)
+{
+    assert(files != NULL);
+    assert(index < files->num_files);
+
+    struct out_file *file = &files->files[index];
+
+    /* buffer will be flushed, make sure file is open */
+    if((file->buffer.used + len > file->buffer.size) &&
+        (out_files_open(files, file) != 0))
+        return (1);
+
+    return (out_buffer_write(&file->buffer, data, len));
+}
+
+/* Flush every partition file, creating files that have not been written
+   to yet ; files are left open
+   - returns 0 (success) or 1 (failure) */
+int
+out_files_flush(struct out_files *files)
+{
+    assert(files != NULL);
+
+    pnum_t i;
+
+    for(i = 0 ; i < files->num_files ; i++) {
+        struct out_file *file = &files->files[i];
+
+        if(((!file->created) || (file->buffer.used > 0)) &&
+            ((out_files_open(files, file) != 0) ||
+            (out_buffer_flush(&file->buffer) != 0)))
+            return (1);
+    }
+    return (0);
+}
+
+/* Un-initialize a set of partition files: flush remaining data, create
+   files that have not been written to (empty partitions) and close them
+   - returns 0 (success) or 1 (failure) */
+int
+uninit_out_files(struct out_files *files)
+{
+    assert(files != NULL);
+
+    int error = 0;
+    pnum_t i;
+
+    for(i = 0 ; i < files->num_files ; i++) {
+        struct out_file *file = &files->files[i];
+
+        if((!error) &&
+            ((!file->created) || (file->buffer.used > 0)) &&
+            (out_files_open(files, file) != 0))
+            error = 1;
+        if((file->buffer.fd >= 0) && (out_files_close(files, file) != 0))
+            error = 1;
+        uninit_out_buffer(&file->buffer);
+    }
+    assert(files->num_open == 0);
+
+    free(files->files);
+    files->files = NULL;
+    free(files->template);
+    files->template = NULL;
+    return (error);
+}
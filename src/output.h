@@ -0,0 +1,97 @@
+/*-
+ * Copyright (c) 2011-2018 Ganael LAPLANCHE <ganael.laplanche@martymac.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHORS OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include "types.h"
+
+/* size_t */
+#include <stddef.h>
+
+#if !defined(OUTPUT_BUFFERS_SIZE)
+#define OUTPUT_BUFFERS_SIZE (16 * 1024 * 1024)  /* memory used to buffer
+                                                   partition files, in bytes */
+#endif
+
+#if !defined(OUTPUT_MIN_BUFFER_SIZE)
+#define OUTPUT_MIN_BUFFER_SIZE 4096             /* per-partition buffer size
+                                                   bounds, in bytes */
+#endif
+#if !defined(OUTPUT_MAX_BUFFER_SIZE)
+#define OUTPUT_MAX_BUFFER_SIZE (64 * 1024)
+#endif
+
+#if !defined(OUTPUT_RESERVED_FDS)
+#define OUTPUT_RESERVED_FDS 16                  /* file descriptors left for
+                                                   other uses */
+#endif
+
+/* A write buffer in front of a file descriptor */
+struct out_buffer {
+    int fd;                         /* file descriptor, -1 if closed */
+    char *data;                     /* buffered data (allocated on first
+                                       write) */
+    size_t size;                    /* buffer size, 0 = unbuffered */
+    size_t used;                    /* buffered bytes */
+};
+
+/* A partition file, written through a buffer */
+struct out_file;
+struct out_file {
+    struct out_buffer buffer;
+    unsigned char created;          /* file has already been created */
+
+    struct out_file* lru_prevp;     /* more recently used open file */
+    struct out_file* lru_nextp;     /* less recently used open file */
+};
+
+/* A set of partition files, written in a single pass. When more files than
+   allowed by RLIMIT_NOFILE must be written, the least recently used ones are
+   closed and re-opened (in append mode) later */
+struct out_files {
+    char *template;                 /* file name template */
+    pnum_t num_files;               /* number of files */
+    struct out_file *files;         /* files, indexed by partition */
+    pnum_t max_open;                /* maximum number of open files */
+    pnum_t num_open;                /* number of open files */
+    struct out_file *lru_head;      /* most recently used open file */
+    struct out_file *lru_tail;      /* least recently used open file */
+};
+
+void init_out_buffer(struct out_buffer *buffer, int fd, size_t size);
+int out_buffer_write(struct out_buffer *buffer, const char *data, size_t len);
+int out_buffer_flush(struct out_buffer *buffer);
+void uninit_out_buffer(struct out_buffer *buffer);
+int init_out_files(struct out_files *files, const char *template,
+    pnum_t num_files, size_t max_buffer_size);
+int out_files_write(struct out_files *files, pnum_t index, const char *data,
+    size_t len);
+int out_files_flush(struct out_files *files);
+int uninit_out_files(struct out_files *files);
+
+#endif /* _OUTPUT_H */
@@ -38,122 +38,355 @@
 /* assert(3) */
 #include <assert.h>
 
-/*******************************************************
- Double-linked list of partitions manipulation functions
- *******************************************************/
-
-/* Add num_parts empty partitions to a double-linked list of partitions
-   from head
-   - if head is NULL, creates a new list ; if not, chains a new list to it
-   - returns with head set to the last element */
+/**************************************
+ Table of partitions handling functions
+ **************************************/
+
+/* Initialize an empty table of partitions */
+void
+init_partitions(struct partition_table *table)
+{
+    assert(table != NULL);
+
+    table->parts = NULL;
+    table->num_parts = 0;
+    table->alloc_parts = 0;
+    return;
+}
+
+/* Add num_parts empty partitions at the end of a table of partitions
+   - the table grows as needed, so existing partitions may move in memory
+   - returns 0 (success) or 1 (failure) */
 int
-add_partitions(struct partition **head, pnum_t num_parts,
+add_partitions(struct partition_table *table, pnum_t num_parts,
     struct program_options *options)
 {
-    assert(head != NULL);
+    assert(table != NULL);
     assert(num_parts > 0);
     assert(options != NULL);
 
-    struct partition **current = head; /* current partition pointer address */
-    struct partition *previous = NULL; /* previous partition pointer */
+    /* grow table if necessary */
+    if((table->num_parts + num_parts) > table->alloc_parts) {
+        pnum_t alloc_parts = max(table->alloc_parts * 2,
+            table->num_parts + num_parts);
+        if_not_realloc(table->parts, sizeof(struct partition) * alloc_parts,
+            return (1);
+        )
+        table->alloc_parts = alloc_parts;
+    }
 
+    /* initialize partitions data */
     pnum_t i = 0;
     while(i < num_parts) {
-        /* backup current structure pointer and initialize a new structure */
-        previous = *current;
-        if_not_malloc(*current, sizeof(struct partition),
-            return (1);
-        )
+        table->parts[table->num_parts].size = options->preload_size;
+        table->parts[table->num_parts].num_files = 0;
+        table->num_parts++;
+        i++;
+    }
+    return (0);
+}
 
-        /* set head on first pass */
-        if(*head == NULL)
-            *head = *current;
+/* Un-initialize a table of partitions */
+void
+uninit_partitions(struct partition_table *table)
+{
+    assert(table != NULL);
 
-        /* initialize partition data */
-        (*current)->size = options->preload_size;
-        (*current)->num_files = 0;
-        (*current)->nextp = NULL;   /* will be set in next pass (see below) */
-        (*current)->prevp = previous;
+    if(table->parts != NULL)
+        free(table->parts);
+    init_partitions(table);
+    return;
+}
 
-        /* set previous' nextp pointer */
-        if(previous != NULL)
-            previous->nextp = *current;
+/* Return a pointer to a given partition */
+struct partition *
+get_partition_at(struct partition_table *table, pnum_t index)
+{
+    assert(table != NULL);
+    assert(index < table->num_parts);
 
-        i++;
+    return (&table->parts[index]);
+}
+
+/***********************************************
+ Min-heap of partitions (least-loaded partitions)
+ ***********************************************/
+
+/* Return the cost (load) of a partition: its size plus file_cost bytes per
+   file (see option -c) */
+fsize_t
+partition_cost(const struct partition *partition, fsize_t file_cost)
+{
+    assert(partition != NULL);
+    assert(file_cost >= 0);
+
+    return (partition->size + (file_cost * (fsize_t)partition->num_files));
+}
+
+/* Return 1 if partition at heap position a must be placed above partition at
+   heap position b, i.e. if it costs less or (same cost) has a lower index */
+static int
+partition_heap_lower(struct partition_heap *heap, pnum_t a, pnum_t b)
+{
+    assert(heap != NULL);
+    assert(a < heap->num_parts);
+    assert(b < heap->num_parts);
+
+    struct partition *pa = &heap->table->parts[heap->heap[a]];
+    struct partition *pb = &heap->table->parts[heap->heap[b]];
+
+    fsize_t ca = partition_cost(pa, heap->file_cost);
+    fsize_t cb = partition_cost(pb, heap->file_cost);
+
+    if(ca != cb)
+        return (ca < cb);
+    return (heap->heap[a] < heap->heap[b]);
+}
+
+/* Sift heap element at position i down to its final position */
+static void
+partition_heap_sift_down(struct partition_heap *heap, pnum_t i)
+{
+    assert(heap != NULL);
+
+    while(1) {
+        pnum_t smallest = i;
+        pnum_t left = (2 * i) + 1;
+        pnum_t right = (2 * i) + 2;
+
+        if((left < heap->num_parts) &&
+            partition_heap_lower(heap, left, smallest))
+            smallest = left;
+        if((right < heap->num_parts) &&
+            partition_heap_lower(heap, right, smallest))
+            smallest = right;
+        if(smallest == i)
+            break;
+
+        pnum_t tmp = heap->heap[i];
+        heap->heap[i] = heap->heap[smallest];
+        heap->heap[smallest] = tmp;
+        i = smallest;
     }
-    return (0);
+    return;
 }
 
-/* Un-initialize a double-linked list of partitions */
-void
-uninit_partitions(struct partition *head)
+/* Initialize a min-heap over partitions of a table
+   - the table must not be resized while the heap is in use
+   - returns 0 (success) or 1 (failure) */
+int
+init_partition_heap(struct partition_heap *heap, struct partition_table *table,
+    fsize_t file_cost)
 {
-    /* be sure to start from last partition */
-    fastfw_list(head);
+    assert(heap != NULL);
+    assert(table != NULL);
+    assert(table->num_parts > 0);
+    assert(file_cost >= 0);
 
-    struct partition *current = head;
-    struct partition *prev = NULL;
+    heap->table = table;
+    heap->heap = NULL;
+    heap->num_parts = 0;
+    heap->file_cost = file_cost;
+
+    if_not_malloc(heap->heap, sizeof(pnum_t) * table->num_parts,
+        return (1);
+    )
+
+    while(heap->num_parts < table->num_parts) {
+        heap->heap[heap->num_parts] = heap->num_parts;
+        heap->num_parts++;
+    }
 
-    while(current != NULL) {
-        prev = current->prevp;
-        free(current);
-        current = prev;
+    /* heapify, partitions may have been loaded already */
+    pnum_t i = heap->num_parts / 2;
+    while(i > 0) {
+        i--;
+        partition_heap_sift_down(heap, i);
     }
+    return (0);
+}
+
+/* Un-initialize a min-heap of partitions */
+void
+uninit_partition_heap(struct partition_heap *heap)
+{
+    assert(heap != NULL);
+
+    if(heap->heap != NULL)
+        free(heap->heap);
+    heap->heap = NULL;
+    heap->table = NULL;
+    heap->num_parts = 0;
     return;
 }
 
-/* Crawl partitions and return the least-loaded partition index */
+/* Return the least-loaded partition index
+   (the lowest index is returned when several partitions have the same cost) */
 pnum_t
-find_smallest_partition_index(struct partition *head)
+partition_heap_min_index(struct partition_heap *heap)
 {
-    assert(head != NULL);
+    assert(heap != NULL);
+    assert(heap->num_parts > 0);
 
-    /* be sure to start at first partition */
-    rewind_list(head);
+    return (heap->heap[0]);
+}
 
-    /* start values */
-    fsize_t smallest_partition_value = head->size;
-    pnum_t smallest_partition_index = 0;
+/* Return a pointer to the least-loaded partition */
+struct partition *
+partition_heap_min(struct partition_heap *heap)
+{
+    assert(heap != NULL);
+    assert(heap->num_parts > 0);
 
-    pnum_t i = 0;
-    while(head != NULL) {
-        if(head->size < smallest_partition_value) {
-            smallest_partition_value = head->size;
-            smallest_partition_index = i;
-        }
-        head = head->nextp;
-        i++;
+    return (&heap->table->parts[heap->heap[0]]);
+}
+
+/* Restore heap order after the least-loaded partition has been loaded */
+void
+partition_heap_update_min(struct partition_heap *heap)
+{
+    assert(heap != NULL);
+    assert(heap->num_parts > 0);
+
+    partition_heap_sift_down(heap, 0);
+    return;
+}
+
+/****************************************************
+ Segment tree of partitions (first partition to fit)
+ ****************************************************/
+
+/* Initialize an empty tree: every partition has PARTITION_NO_ROOM */
+void
+init_partition_fit_tree(struct partition_fit_tree *tree)
+{
+    assert(tree != NULL);
+
+    tree->rooms = NULL;
+    tree->leaves = 0;
+    return;
+}
+
+/* Un-initialize a tree */
+void
+uninit_partition_fit_tree(struct partition_fit_tree *tree)
+{
+    assert(tree != NULL);
+
+    if(tree->rooms != NULL)
+        free(tree->rooms);
+    init_partition_fit_tree(tree);
+    return;
+}
+
+/* Grow a tree to hold at least num_leaves leaves
+   - returns 0 (success) or 1 (failure, tree left untouched) */
+static int
+partition_fit_tree_grow(struct partition_fit_tree *tree, pnum_t num_leaves)
+{
+    assert(tree != NULL);
+
+    fsize_t *rooms = NULL;
+    pnum_t leaves = (tree->leaves > 0) ? tree->leaves : 1;
+    pnum_t i;
+
+    while(leaves < num_leaves)
+        leaves *= 2;
+
+    if_not_malloc(rooms, sizeof(fsize_t) * 2 * leaves,
+        return (1);
+    )
+
+    /* copy existing leaves, then rebuild internal nodes */
+    for(i = 0 ; i < leaves ; i++)
+        rooms[leaves + i] = (i < tree->leaves) ?
+            tree->rooms[tree->leaves + i] : PARTITION_NO_ROOM;
+    for(i = leaves - 1 ; i > 0 ; i--)
+        rooms[i] = max(rooms[2 * i], rooms[(2 * i) + 1]);
+
+    if(tree->rooms != NULL)
+        free(tree->rooms);
+    tree->rooms = rooms;
+    tree->leaves = leaves;
+    return (0);
+}
+
+/* Set the room of partition index
+   - returns 0 (success) or 1 (failure) */
+int
+partition_fit_tree_set(struct partition_fit_tree *tree, pnum_t index,
+    fsize_t room)
+{
+    assert(tree != NULL);
+
+    if((index >= tree->leaves) &&
+        (partition_fit_tree_grow(tree, index + 1) != 0))
+        return (1);
+
+    pnum_t i = tree->leaves + index;
+    tree->rooms[i] = room;
+    while(i > 1) {
+        i /= 2;
+        tree->rooms[i] = max(tree->rooms[2 * i], tree->rooms[(2 * i) + 1]);
     }
-    return (smallest_partition_index);
+    return (0);
 }
 
-/* Return a pointer to a given partition */
-struct partition *
-get_partition_at(struct partition *head, pnum_t index)
+/* Return the lowest partition index whose room is greater than or equal to
+   size, or the number of leaves if there is none */
+pnum_t
+partition_fit_tree_first(struct partition_fit_tree *tree, fsize_t size)
 {
-    assert(head != NULL);
+    assert(tree != NULL);
 
-    /* be sure to start at first partition */
-    rewind_list(head);
+    if((tree->leaves == 0) || (tree->rooms[1] < size))
+        return (tree->leaves);
 
-    pnum_t i = 0;
-    while((head != NULL) && (i < index)) {
-        head = head->nextp;
-        i++;
+    /* descend, preferring left (lower indexes) */
+    pnum_t i = 1;
+    while(i < tree->leaves) {
+        i *= 2;
+        if(tree->rooms[i] < size)
+            i++;
     }
-    return (head);
+    return (i - tree->leaves);
 }
 
-/* Print partitions from head */
+/* Print partitions from a table of partitions */
 void
-print_partitions(struct partition *head)
+print_partitions(struct partition_table *table)
 {
+    assert(table != NULL);
+
     pnum_t i = 0;
-    while(head != NULL) {
+    while(i < table->num_parts) {
         fprintf(stderr, "Part #%d: size = %lld, %lld file(s)\n", i,
-            head->size, head->num_files);
-        head = head->nextp;
+            table->parts[i].size, table->parts[i].num_files);
         i++;
     }
     return;
 }
+
+/* Return the imbalance ratio of a table of partitions: cost of the
+   most-loaded partition divided by the mean cost (1 is a perfect balance) */
+double
+partitions_imbalance(struct partition_table *table, fsize_t file_cost)
+{
+    assert(table != NULL);
+    assert(file_cost >= 0);
+
+    fsize_t max_cost = 0;
+    fsize_t total_cost = 0;
+    pnum_t i;
+
+    for(i = 0 ; i < table->num_parts ; i++) {
+        fsize_t cost = partition_cost(&table->parts[i], file_cost);
+        if(cost > max_cost)
+            max_cost = cost;
+        total_cost += cost;
+    }
+
+    if(total_cost <= 0)
+        return (1.0);
+    return ((double)max_cost * table->num_parts / total_cost);
+}
@@ -32,21 +32,62 @@
 
 #include <sys/types.h>
 
+/* LLONG_MIN, LLONG_MAX */
+#include <limits.h>
+
 /* A partition (group of file entries) */
-struct partition;
 struct partition {
     fsize_t size;               /* size in bytes */
     fnum_t num_files;           /* number of files */
+};
+
+/* A table of partitions, indexed by partition number */
+struct partition_table {
+    struct partition *parts;    /* contiguous array of partitions */
+    pnum_t num_parts;           /* number of partitions */
+    pnum_t alloc_parts;         /* number of allocated partitions */
+};
+
+/* A min-heap of partitions, used to find the least-loaded partition ;
+   a partition's load is its size plus file_cost bytes per file */
+struct partition_heap {
+    struct partition_table *table;  /* partitions */
+    pnum_t *heap;                   /* partition indexes, least-loaded first */
+    pnum_t num_parts;               /* number of partitions */
+    fsize_t file_cost;              /* cost of a file, in bytes */
+};
 
-    struct partition* nextp;    /* next partition */
-    struct partition* prevp;    /* previous one */
+/* A max segment tree over partitions' room (how big a file they can still
+   accept), used to find the first partition a file fits in */
+struct partition_fit_tree {
+    fsize_t *rooms;                 /* room of each node, leaves (one per
+                                       partition index) at [leaves,
+                                       2 * leaves[ */
+    pnum_t leaves;                  /* number of leaves (power of 2) */
 };
+#define PARTITION_NO_ROOM   LLONG_MIN   /* partition cannot take any file */
+#define PARTITION_ANY_ROOM  LLONG_MAX   /* partition can take any file */
 
-int add_partitions(struct partition **head, pnum_t num_parts,
+void init_partitions(struct partition_table *table);
+int add_partitions(struct partition_table *table, pnum_t num_parts,
     struct program_options *options);
-void uninit_partitions(struct partition *head);
-pnum_t find_smallest_partition_index(struct partition *head);
-struct partition * get_partition_at(struct partition *head, pnum_t index);
-void print_partitions(struct partition *head);
+void uninit_partitions(struct partition_table *table);
+struct partition *get_partition_at(struct partition_table *table,
+    pnum_t index);
+void print_partitions(struct partition_table *table);
+double partitions_imbalance(struct partition_table *table, fsize_t file_cost);
+fsize_t partition_cost(const struct partition *partition, fsize_t file_cost);
+int init_partition_heap(struct partition_heap *heap,
+    struct partition_table *table, fsize_t file_cost);
+void uninit_partition_heap(struct partition_heap *heap);
+pnum_t partition_heap_min_index(struct partition_heap *heap);
+struct partition *partition_heap_min(struct partition_heap *heap);
+void partition_heap_update_min(struct partition_heap *heap);
+void init_partition_fit_tree(struct partition_fit_tree *tree);
+void uninit_partition_fit_tree(struct partition_fit_tree *tree);
+int partition_fit_tree_set(struct partition_fit_tree *tree, pnum_t index,
+    fsize_t room);
+pnum_t partition_fit_tree_first(struct partition_fit_tree *tree,
+    fsize_t size);
 
 #endif /* _PARTITION_H */
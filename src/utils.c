@@ -37,14 +37,9 @@
 /* fprintf(3), snprintf(3) */
 #include <stdio.h>
 
-/* fts(3) */
+/* stat(2) */
 #include <sys/types.h>
 #include <sys/stat.h>
-#if defined(EMBED_FTS)
-#include "fts.h"
-#else
-#include <fts.h>
-#endif
 
 /* strerror(3) */
 #include <string.h>
@@ -85,68 +80,16 @@ get_num_digits(double i)
     return (logvalue >= 0 ? (unsigned int)logvalue + 1 : 0);
 }
 
-/* Return the size of a file or directory
-   - a pointer to an existing stat must be provided */
+/* Return the size of a file
+   - a pointer to an existing stat must be provided
+   - only regular files have a size, other file types are 0-sized
+     (directory sizes are computed while crawling them) */
 fsize_t
-get_size(char *file_path, struct stat *file_stat,
-    struct program_options *options)
+get_size(struct stat *file_stat)
 {
-    assert(file_path != NULL);
     assert(file_stat != NULL);
-    assert(options != NULL);
-
-    fsize_t file_size = 0;  /* current return value */
-
-    /* if file_path is not a directory,
-       return st_size for regular files (only) */
-    if(!S_ISDIR(file_stat->st_mode)) {
-        return (S_ISREG(file_stat->st_mode) ? file_stat->st_size : 0);
-    }
 
-    /* directory, use fts */
-    FTS *ftsp = NULL;
-    FTSENT *p = NULL;
-    int fts_options = (options->follow_symbolic_links == OPT_FOLLOWSYMLINKS) ?
-        FTS_LOGICAL : FTS_PHYSICAL;
-    fts_options |= (options->cross_fs_boundaries == OPT_NOCROSSFSBOUNDARIES) ?
-        FTS_XDEV : 0;
-
-    char *fts_argv[] = { file_path, NULL };
-    if((ftsp = fts_open(fts_argv, fts_options, NULL)) == NULL) {
-        fprintf(stderr, "%s: fts_open()\n", file_path);
-        return (0);
-    }
-
-    while((p = fts_read(ftsp)) != NULL) {
-        switch (p->fts_info) {
-            case FTS_DNR:   /* un-readable directory */
-            case FTS_ERR:   /* misc error */
-            case FTS_NS:    /* stat() error */
-                fprintf(stderr, "%s: %s\n", p->fts_path,
-                    strerror(p->fts_errno));
-                continue;
-
-            case FTS_DC:
-                fprintf(stderr, "%s: filesystem loop detected\n", p->fts_path);
-                continue;
-
-            case FTS_F:
-                file_size += p->fts_statp->st_size;
-                continue;
-
-            /* skip everything else (only count regular files' size) */
-            default:
-                continue;
-        }
-    }
-
-    if(errno != 0)
-        fprintf(stderr, "%s: fts_read()\n", file_path);
-
-    if(fts_close(ftsp) < 0)
-        fprintf(stderr, "%s: fts_close()\n", file_path);
-
-    return (file_size);
+    return (S_ISREG(file_stat->st_mode) ? file_stat->st_size : 0);
 }
 
 /* Return absolute path for given path
@@ -278,7 +221,7 @@ str_match(const char * const * const array, const unsigned int num,
      the entire file hierarchy)
    - return 0 if file is not valid, 1 if it is */
 int
-valid_filename(char *filename, struct program_options *options,
+valid_filename(const char *filename, struct program_options *options,
     unsigned char is_leaf)
 {
     assert(filename != NULL);
@@ -322,75 +265,36 @@ valid_filename(char *filename, struct program_options *options,
     return (valid);
 }
 
-/* Create a copy of environ(7) and return its address
+/* Create a copy of environ(7), with room for num_extra more variables, and
+   return its address
+   - env_size is set to the number of variables copied
    - return a pointer to the copy or NULL if error
    - returned environ must be freed later */
 char **
-clone_env(void)
+clone_env(unsigned int num_extra, unsigned int *env_size)
 {
-    unsigned int env_size = 0;
+    assert(env_size != NULL);
+
     char **new_env = NULL;
+    unsigned int i;
 
     /* import original environ */
     extern char **environ;
 
     /* compute environ size */
-    while(environ[env_size]) env_size++;
-    /* ending NULL */
-    env_size++;
-
-    size_t malloc_size = sizeof(char *) * env_size;
-    if_not_malloc(new_env, malloc_size,
-        /* just print error message (within macro code) */
-    )
-    else {
-        /* copy each pointer, beginning from the ending NULL value */
-        while(env_size > 0) {
-            new_env[env_size - 1] = environ[env_size - 1];
-            env_size--;
-        }
-    }
-    return (new_env);
-}
-
-/* Push a str pointer to a cloned environ(7)
-   - return enlarged environ through env
-   - returned environ must be freed later
-   - return 0 (success) or 1 (failure) */
-int
-push_env(char *str, char ***env)
-{
-    assert(str != NULL);
-    assert(env != NULL);
-    assert(*env != NULL);
-
-    unsigned int env_size = 0;
-    char **new_env = NULL;
-
-    /* compute environ size */
-    while((*env)[env_size]) env_size++;
-    /* add our pointer */
-    env_size++;
-    /* add ending NULL */
-    env_size++;
+    *env_size = 0;
+    while(environ[*env_size]) (*env_size)++;
 
-    size_t malloc_size = sizeof(char *) * env_size;
+    /* add extra variables and ending NULL */
+    size_t malloc_size = sizeof(char *) * (*env_size + num_extra + 1);
     if_not_malloc(new_env, malloc_size,
-        return (1);
+        return (NULL);
     )
 
-    /* copy each pointer, beginning from the ending NULL value */
-    new_env[env_size - 1] = NULL;
-    new_env[env_size - 2] = str;
-    env_size -= 2;
-    while(env_size > 0) {
-        new_env[env_size - 1] = (*env)[env_size - 1];
-        env_size--;
-    }
-
-    /* free previous environment and update env */
-    free(*env);
-    *env = new_env;
+    /* copy each pointer */
+    for(i = 0 ; i < *env_size ; i++)
+        new_env[i] = environ[i];
+    new_env[*env_size] = NULL;
 
-    return (0);
+    return (new_env);
 }
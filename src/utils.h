@@ -73,16 +73,14 @@
     }
 
 unsigned int get_num_digits(double i);
-fsize_t get_size(char *file_path, struct stat *file_stat,
-    struct program_options *options);
+fsize_t get_size(struct stat *file_stat);
 char *abs_path(const char *path);
 int str_push(char ***array, unsigned int *num, const char * const str);
 void str_cleanup(char ***array, unsigned int *num);
 int str_match(const char * const * const array, const unsigned int num,
     const char * const str, const unsigned char ignore_case);
-int valid_filename(char *filename, struct program_options *options,
+int valid_filename(const char *filename, struct program_options *options,
     unsigned char is_leaf);
-char ** clone_env(void);
-int push_env(char *str, char ***env);
+char ** clone_env(unsigned int num_extra, unsigned int *env_size);
 
 #endif /* _UTILS_H */